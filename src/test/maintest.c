@@ -14,16 +14,31 @@
  * limitations under the License.
  */
 
+#include "../util/aio.h"
+#include "../util/alloc.h"
+#include "../util/hash.h"
 #include "../util/str.h"
+#include "../util/inflate.h"
+#include "../util/intern.h"
 #include "../util/io.h"
 #include "../util/tree.h"
+#include "../util/utf8.h"
+#include "../util/vec.h"
 #include "../util/json.h"
+#include "../util/logwtr.h"
+#include "../util/lz4.h"
+#include "../util/prefetch.h"
+#include "../util/rope.h"
+#include "../util/scan.h"
+#include "../util/shared.h"
+#include "../util/thread.h"
 #include "../util/common.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
 #include <string.h>
 #include <time.h>
+#include <limits.h>
 
 static int line_reader_speed(int argc, char **argv)
 {
@@ -102,6 +117,31 @@ done:
     return 0;
 }
 
+static int line_count_speed(int argc, char **argv)
+{
+    DWORD start_tm = GetTickCount();
+    DWORD end_tm;
+    struct strrdr_t mr;
+    uint64_t lines;
+    assert(argc > 0);
+
+    po_mmap_reader_init(&mr, argv[0]);
+    if (strrdr_open(&mr) < 0 || strrdr_count_lines(&mr, &lines) < 0) {
+        const char *error;
+        int errnum;
+        strrdr_get_error(&mr, &error, &errnum);
+        printf("Got errnum=%d error=\"%s\"\n", errnum, error);
+        goto done;
+    }
+
+    end_tm = GetTickCount();
+    printf("lines=%llu tm=%u\n", (unsigned long long)lines, (unsigned)(end_tm - start_tm));
+done:
+    po_mmap_reader_uninit(&mr);
+
+    return 0;
+}
+
 static const char *line_reader_str =
 "0123456789\n"
 "01234567890123456789\n"
@@ -155,17 +195,14 @@ static size_t util_count_chars(const char *str, char c)
     return n;
 }
 
-static unsigned long util_djb2_hash(const unsigned char *str,
-                                    size_t len,
-                                    unsigned long *resume_hash)
+/* sets cb to line_reader_str repeated times times, null-terminated */
+static void util_repeat_line_reader_str(struct char_buffer_t *cb, size_t times)
 {
-    unsigned long hash = resume_hash ? *resume_hash : 5381;
-    const char *end = str + len;
-
-    while (str != end)
-        hash = ((hash << 5) + hash) + (int)(*str++); /* hash * 33 + c */
-
-    return hash;
+    size_t i;
+    char_buffer_clear(cb);
+    for (i = 0; i < times; ++i)
+        char_buffer_append(cb, line_reader_str, strlen(line_reader_str));
+    char_buffer_push_char(cb, '\0');
 }
 
 static void test_assert(int expr,
@@ -210,24 +247,26 @@ static void abort_expression_return(const char *expr,
 
 #define TEST_TXT_FILE "test.txt"
 
-static void line_reader_one_test(const char *file_contents, const char *file_path)
+/* source reader used by line_reader_one_test() */
+static void (* line_reader_src_init)(struct strrdr_t *, const char *) = po_file_reader_init;
+static void (* line_reader_src_uninit)(struct strrdr_t *) = po_file_reader_uninit;
+
+/* reads all lines of src through a line reader and checks them against
+ * contents; returns nonzero if the reader could not be opened */
+static int line_reader_check(struct strrdr_t *src, const char *contents)
 {
-    struct strrdr_t fr, lr;
+    struct strrdr_t lr;
     ro_seg_t seg;
     int ret;
-    struct char_buffer_t cb;
-    const size_t expected_num_of_lines = util_count_chars(file_contents, '\n');
-    const size_t file_contents_size = strlen(file_contents);
-    const unsigned long expected_hash = util_djb2_hash(file_contents, file_contents_size, NULL);
-    unsigned long computed_hash = 5381;
+    const size_t expected_num_of_lines = util_count_chars(contents, '\n');
+    const size_t contents_size = strlen(contents);
+    const uint64_t expected_hash = hash64(contents, contents_size, 0);
+    struct hash_state_t computed_hash;
     size_t lines = 0;
     int got_error = 0, missing_newline = 0;
 
-    ASSERT_EXP(util_write_file(file_path, file_contents) == 0);
-
-    char_buffer_init(&cb);
-    po_file_reader_init(&fr, file_path);
-    po_line_reader_init(&lr, &fr);
+    hash_state_init(&computed_hash, 0);
+    po_line_reader_init(&lr, src);
     if ((ret = strrdr_open(&lr)) < 0) {
         const char *error;
         int errnum;
@@ -239,9 +278,7 @@ static void line_reader_one_test(const char *file_contents, const char *file_pat
 
     while ((ret = strrdr_read(&lr, &seg)) > 0) {
         ASSERT_EXP(!missing_newline);
-        /* char_buffer_set_ro_seg(&cb, &seg); */
-        computed_hash = util_djb2_hash(seg.start, seg.size, &computed_hash);
-        /* printf("LINE (len=%4d): \"%s\"\n", ret, cb.buf); */
+        hash_state_update(&computed_hash, &seg);
 #if 0
         printf("LINE (len=%4d): \"", ret);
         fwrite(seg.start, 1, seg.size, stdout);
@@ -256,22 +293,75 @@ static void line_reader_one_test(const char *file_contents, const char *file_pat
     }
 
     ASSERT_EXP(lines == expected_num_of_lines);
-    ASSERT_EXP(computed_hash == expected_hash);
-
-    //printf("Finished line reader test.  Data: size=%4u lines=%u\n",
-        //(unsigned)file_contents_size, (unsigned)lines);
+    ASSERT_EXP(hash_state_final(&computed_hash) == expected_hash);
 
 done:
     po_line_reader_uninit(&lr);
-    po_file_reader_uninit(&fr);
-    char_buffer_uninit(&cb);
+    return got_error;
+}
+
+static void line_reader_one_test(const char *file_contents, const char *file_path)
+{
+    struct strrdr_t fr;
+    int got_error;
+
+    ASSERT_EXP(util_write_file(file_path, file_contents) == 0);
+
+    line_reader_src_init(&fr, file_path);
+    got_error = line_reader_check(&fr, file_contents);
+    line_reader_src_uninit(&fr);
 
     if (os_unlink(file_path))
         printf("Unlink for file %s failed: %d\n", file_path, os_errno());
     ASSERT_MSG(!got_error, "Got error when opening file.");
 }
 
-extern size_t file_reader_read_buflen;
+static void small_file_reader_init(struct strrdr_t *reader, const char *path)
+{
+    po_file_reader_init_buflen(reader, path, 5);
+}
+
+static void line_reader_batch_one_test(const char *file_contents,
+                                       size_t buflen,
+                                       size_t max_lines)
+{
+    struct strrdr_t fr, lr;
+    ro_seg_t lines[16];
+    const size_t file_contents_size = strlen(file_contents);
+    struct hash_state_t computed_hash;
+    size_t i, total_lines = 0, batches = 0;
+    int ret;
+
+    ASSERT_EXP(max_lines <= ARRAY_SIZE(lines));
+    ASSERT_EXP(util_write_file(TEST_TXT_FILE, file_contents) == 0);
+
+    hash_state_init(&computed_hash, 0);
+    po_file_reader_init_buflen(&fr, TEST_TXT_FILE, buflen);
+    po_line_reader_init(&lr, &fr);
+    ASSERT_ZERO(strrdr_open(&lr));
+    while ((ret = po_line_reader_read_batch(&lr, lines, max_lines)) > 0) {
+        ASSERT_EXP((size_t)ret <= max_lines);
+        for (i = 0; i < (size_t)ret; ++i) {
+            ASSERT_EXP(lines[i].size > 0);
+            if (lines[i].start[lines[i].size-1] == '\n')
+                ++total_lines;
+            hash_state_update(&computed_hash, &lines[i]);
+        }
+        ++batches;
+    }
+    ASSERT_EXP(ret == 0);
+    ASSERT_EXP(total_lines == util_count_chars(file_contents, '\n'));
+    ASSERT_EXP(hash_state_final(&computed_hash) ==
+               hash64(file_contents, file_contents_size, 0));
+    /* a single block of complete lines comes back in one batch */
+    if (buflen >= file_contents_size && max_lines == ARRAY_SIZE(lines) &&
+            file_contents_size > 0 && file_contents[file_contents_size-1] == '\n')
+        ASSERT_EXP(batches == 1);
+
+    po_line_reader_uninit(&lr);
+    po_file_reader_uninit(&fr);
+    os_unlink(TEST_TXT_FILE);
+}
 
 static int test_line_reader(int argc, char **argv)
 {
@@ -285,8 +375,1455 @@ static int test_line_reader(int argc, char **argv)
     line_reader_one_test("",              TEST_TXT_FILE);
 
     /* run the same test as above, but decrease the read buffer */
-    file_reader_read_buflen = 5;
+    line_reader_src_init = small_file_reader_init;
     line_reader_one_test(line_reader_str, TEST_TXT_FILE);
+    line_reader_src_init = po_file_reader_init;
+
+    line_reader_batch_one_test(line_reader_str, 1024, 16);
+    line_reader_batch_one_test(line_reader_str, 1024, 3);
+    line_reader_batch_one_test(line_reader_str, 5, 16);
+    line_reader_batch_one_test(line_reader_str, 17, 2);
+    line_reader_batch_one_test("abc\ndef", 1024, 16);
+    line_reader_batch_one_test("", 1024, 16);
+
+    /* wc -l */
+    {
+        struct strrdr_t fr;
+        uint64_t lines;
+        ASSERT_EXP(util_write_file(TEST_TXT_FILE, line_reader_str) == 0);
+        po_file_reader_init_buflen(&fr, TEST_TXT_FILE, 7);
+        ASSERT_ZERO(strrdr_open(&fr));
+        ASSERT_ZERO(strrdr_count_lines(&fr, &lines));
+        ASSERT_EXP(lines == util_count_chars(line_reader_str, '\n'));
+        po_file_reader_uninit(&fr);
+        os_unlink(TEST_TXT_FILE);
+    }
+
+    /* errors come back through strrdr_get_error */
+    {
+        struct strrdr_t fr;
+        const char *error;
+        int errnum;
+        po_file_reader_init(&fr, TEST_TXT_FILE);
+        ASSERT_EXP(strrdr_open(&fr) < 0);
+        strrdr_get_error(&fr, &error, &errnum);
+        ASSERT_EXP(errnum != 0 && *error != '\0');
+        po_file_reader_uninit(&fr);
+    }
+
+    return 0;
+}
+
+/* TEST file_writer */
+
+/* reads the whole file into cb */
+static void util_read_file(const char *file, struct char_buffer_t *cb)
+{
+    struct strrdr_t fr;
+    ro_seg_t seg;
+
+    char_buffer_clear(cb);
+    po_file_reader_init(&fr, file);
+    ASSERT_ZERO(strrdr_open(&fr));
+    while (strrdr_read(&fr, &seg) > 0)
+        char_buffer_append_ro_seg(cb, &seg);
+    po_file_reader_uninit(&fr);
+}
+
+static void file_writer_one_test(size_t buflen)
+{
+    struct strwtr_t fw;
+    struct char_buffer_t expected, actual;
+    seg_t exp_seg, act_seg;
+    ro_seg_t seg;
+    char record[32];
+    char big[1000];
+    int i;
+
+    char_buffer_init(&expected);
+    char_buffer_init(&actual);
+    memset(big, 'x', sizeof(big));
+
+    po_file_writer_init_buflen(&fw, TEST_TXT_FILE, buflen);
+    ASSERT_ZERO(strwtr_open(&fw));
+    for (i = 0; i < 10000; ++i) {
+        seg.start = record;
+        seg.size = (size_t)sprintf(record, "record %d\n", i);
+        if (i % 1000 == 999) {
+            /* larger than the buffer */
+            seg.start = big;
+            seg.size = sizeof(big);
+        }
+        ASSERT_ZERO(strwtr_write(&fw, &seg));
+        char_buffer_append_ro_seg(&expected, &seg);
+    }
+    ASSERT_ZERO(strwtr_flush(&fw));
+    ASSERT_ZERO(strwtr_flush(&fw));
+
+    util_read_file(TEST_TXT_FILE, &actual);
+    char_buffer_get(&expected, &exp_seg);
+    char_buffer_get(&actual, &act_seg);
+    ASSERT_EXP(exp_seg.size == act_seg.size);
+    ASSERT_EXP(memcmp(exp_seg.start, act_seg.start, exp_seg.size) == 0);
+
+    /* uninit flushes what is left */
+    ASSERT_ZERO(strwtr_write(&fw, ro_seg_set_static(&seg, "tail")));
+    po_file_writer_uninit(&fw);
+    util_read_file(TEST_TXT_FILE, &actual);
+    char_buffer_get(&actual, &act_seg);
+    ASSERT_EXP(act_seg.size == exp_seg.size + 4);
+    ASSERT_EXP(memcmp(act_seg.start + exp_seg.size, "tail", 4) == 0);
+
+    os_unlink(TEST_TXT_FILE);
+    char_buffer_uninit(&expected);
+    char_buffer_uninit(&actual);
+}
+
+static int test_file_writer(int argc, char **argv)
+{
+    struct strwtr_t fw;
+    const char *error;
+    int errnum;
+    (void)argc; (void)argv;
+
+    file_writer_one_test(1);
+    file_writer_one_test(100);
+    file_writer_one_test(4096);
+    file_writer_one_test(1024 * 1024);
+
+    po_file_writer_init(&fw, "no_such_dir/" TEST_TXT_FILE);
+    ASSERT_EXP(strwtr_open(&fw) < 0);
+    strwtr_get_error(&fw, &error, &errnum);
+    ASSERT_EXP(errnum != 0);
+    po_file_writer_uninit(&fw);
+
+    return 0;
+}
+
+/* TEST log_writer */
+
+#define LOG_WRITER_THREADS 8
+#define LOG_WRITER_RECORDS 200
+#define LOG_WRITER_BATCH 1000
+
+struct log_producer_t
+{
+    struct log_writer_t *lw;
+    int id;
+    int error;
+};
+
+static void log_producer_run(void *arg)
+{
+    struct log_producer_t *p = (struct log_producer_t *)arg;
+    struct strwtr_t ls;
+    char record[32];
+    ro_seg_t seg;
+    int i;
+
+    po_log_stream_init(&ls, p->lw);
+    p->error = strwtr_open(&ls) != 0;
+    for (i = 0; i < LOG_WRITER_RECORDS && !p->error; ++i) {
+        seg.start = record;
+        seg.size = (size_t)sprintf(record, "%d %d\n", p->id, i);
+        p->error = strwtr_write(&ls, &seg) != 0;
+        if (i % 10 == 9)
+            p->error = p->error || strwtr_flush(&ls) != 0;
+    }
+    po_log_stream_uninit(&ls);
+}
+
+static int test_log_writer(int argc, char **argv)
+{
+    struct log_writer_t lw;
+    struct log_producer_t producers[LOG_WRITER_THREADS];
+    thread_t threads[LOG_WRITER_THREADS];
+    int next_record[LOG_WRITER_THREADS];
+    struct char_buffer_t contents;
+    seg_t buf;
+    ro_seg_t record;
+    const char *p, *end;
+    const char *error;
+    uint64_t seq = 0;
+    int errnum, i;
+    (void)argc; (void)argv;
+
+    /* records submitted while the writer is held back share a sync; the
+     * writer is not started until the whole batch is in */
+    os_unlink(TEST_TXT_FILE);
+    log_writer_init(&lw, TEST_TXT_FILE);
+    ro_seg_set_static(&record, "record\n");
+    for (i = 0; i < LOG_WRITER_BATCH; ++i)
+        ASSERT_ZERO(log_writer_submit(&lw, &record, &seq));
+    ASSERT_ZERO(log_writer_open(&lw));
+    ASSERT_ZERO(log_writer_wait(&lw, seq));
+    ASSERT_EXP(log_writer_get_syncs(&lw) >= 1 && log_writer_get_syncs(&lw) <= 2);
+    log_writer_uninit(&lw);
+
+    os_unlink(TEST_TXT_FILE);
+    log_writer_init(&lw, TEST_TXT_FILE);
+    ASSERT_ZERO(log_writer_open(&lw));
+    for (i = 0; i < LOG_WRITER_THREADS; ++i) {
+        producers[i].lw = &lw;
+        producers[i].id = i;
+        producers[i].error = 0;
+        next_record[i] = 0;
+        ASSERT_ZERO(thread_create(&threads[i], log_producer_run, &producers[i]));
+    }
+    for (i = 0; i < LOG_WRITER_THREADS; ++i) {
+        thread_join(&threads[i]);
+        ASSERT_EXP(!producers[i].error);
+    }
+    log_writer_uninit(&lw);
+
+    /* every record is there, in order within its stream */
+    char_buffer_init(&contents);
+    util_read_file(TEST_TXT_FILE, &contents);
+    char_buffer_get(&contents, &buf);
+    for (p = buf.start, end = buf.start + buf.size; p < end; ) {
+        int id, n;
+        ASSERT_EXP(sscanf(p, "%d %d", &id, &n) == 2);
+        ASSERT_EXP(id >= 0 && id < LOG_WRITER_THREADS);
+        ASSERT_EXP(n == next_record[id]++);
+        p = (const char *)memchr(p, '\n', (size_t)(end - p)) + 1;
+    }
+    for (i = 0; i < LOG_WRITER_THREADS; ++i)
+        ASSERT_EXP(next_record[i] == LOG_WRITER_RECORDS);
+    char_buffer_uninit(&contents);
+    os_unlink(TEST_TXT_FILE);
+
+    log_writer_init(&lw, "no_such_dir/" TEST_TXT_FILE);
+    ASSERT_EXP(log_writer_open(&lw) < 0);
+    log_writer_get_error(&lw, &error, &errnum);
+    ASSERT_EXP(errnum != 0);
+    log_writer_uninit(&lw);
+
+    return 0;
+}
+
+/* TEST memory_reader */
+
+static void memory_reader_one_test(const char *contents, size_t segment_size)
+{
+    struct strrdr_t mr;
+    ro_seg_t pieces[3];
+    const size_t size = strlen(contents);
+
+    po_memory_reader_init(&mr, contents, size, segment_size);
+    ASSERT_ZERO(line_reader_check(&mr, contents));
+    po_memory_reader_uninit(&mr);
+
+    /* the same data split into a scatter list, with an empty piece */
+    pieces[0].start = contents;
+    pieces[0].size = size / 3;
+    pieces[1].start = contents + pieces[0].size;
+    pieces[1].size = 0;
+    pieces[2].start = pieces[1].start;
+    pieces[2].size = size - pieces[0].size;
+    po_memory_reader_init_scatter(&mr, pieces, ARRAY_SIZE(pieces), segment_size);
+    ASSERT_ZERO(line_reader_check(&mr, contents));
+    po_memory_reader_uninit(&mr);
+}
+
+static int test_memory_reader(int argc, char **argv)
+{
+    static const char *contents[] = {
+        "abc", "abc\ndef", "abc\n\n\ndef", "\n", ""
+    };
+    struct strrdr_t mr;
+    ro_seg_t seg;
+    size_t i, segment_size;
+    (void)argc; (void)argv;
+
+    /* segments point into the buffer */
+    po_memory_reader_init(&mr, line_reader_str, strlen(line_reader_str), 10);
+    ASSERT_ZERO(strrdr_open(&mr));
+    ASSERT_INT(strrdr_read(&mr, &seg), 10);
+    ASSERT_EXP(seg.start == line_reader_str);
+    ASSERT_INT(strrdr_read(&mr, &seg), 10);
+    ASSERT_EXP(seg.start == line_reader_str + 10);
+    po_memory_reader_uninit(&mr);
+
+    for (segment_size = 0; segment_size < 50; ++segment_size) {
+        memory_reader_one_test(line_reader_str, segment_size);
+        for (i = 0; i < ARRAY_SIZE(contents); ++i)
+            memory_reader_one_test(contents[i], segment_size);
+    }
+
+    return 0;
+}
+
+/* TEST mmap_reader */
+
+extern size_t mmap_reader_window;
+
+static int test_mmap_reader(int argc, char **argv)
+{
+    struct strrdr_t mr;
+    struct char_buffer_t contents;
+    const size_t default_window = mmap_reader_window;
+    const char *text;
+    seg_t buf;
+    ro_seg_t seg;
+    size_t offset = 0, reads = 0;
+    int ret;
+    (void)argc; (void)argv;
+
+    /* large enough to span several windows of the smallest size */
+    char_buffer_init(&contents);
+    util_repeat_line_reader_str(&contents, 1000);
+    char_buffer_get(&contents, &buf);
+    text = buf.start;
+    ASSERT_EXP(util_write_file(TEST_TXT_FILE, text) == 0);
+
+    /* rounded up to the page size or allocation granularity */
+    mmap_reader_window = 1;
+    po_mmap_reader_init(&mr, TEST_TXT_FILE);
+    ASSERT_ZERO(strrdr_open(&mr));
+    while ((ret = strrdr_read(&mr, &seg)) > 0) {
+        ASSERT_EXP((size_t)ret == seg.size);
+        ASSERT_EXP(memcmp(seg.start, text + offset, seg.size) == 0);
+        offset += seg.size;
+        ++reads;
+    }
+    ASSERT_EXP(ret == 0);
+    ASSERT_EXP(offset == strlen(text));
+    ASSERT_EXP(reads > 1);
+    po_mmap_reader_uninit(&mr);
+
+    {
+        uint64_t lines;
+        po_mmap_reader_init(&mr, TEST_TXT_FILE);
+        ASSERT_ZERO(strrdr_open(&mr));
+        ASSERT_ZERO(strrdr_count_lines(&mr, &lines));
+        ASSERT_EXP(lines == util_count_chars(text, '\n'));
+        po_mmap_reader_uninit(&mr);
+    }
+
+    /* a window too large for a read's return value is capped */
+    mmap_reader_window = (size_t)-1;
+    po_mmap_reader_init(&mr, TEST_TXT_FILE);
+    ASSERT_ZERO(strrdr_open(&mr));
+    ASSERT_EXP(strrdr_read(&mr, &seg) == (int)strlen(text));
+    ASSERT_EXP(strrdr_read(&mr, &seg) == 0);
+    po_mmap_reader_uninit(&mr);
+    mmap_reader_window = 1;
+    os_unlink(TEST_TXT_FILE);
+
+    /* a missing file reports an error */
+    po_mmap_reader_init(&mr, TEST_TXT_FILE);
+    ASSERT_EXP(strrdr_open(&mr) < 0);
+    po_mmap_reader_uninit(&mr);
+
+    line_reader_src_init = po_mmap_reader_init;
+    line_reader_src_uninit = po_mmap_reader_uninit;
+    line_reader_one_test(text, TEST_TXT_FILE);
+    line_reader_one_test(line_reader_str, TEST_TXT_FILE);
+    line_reader_one_test("abc\ndef",      TEST_TXT_FILE);
+    line_reader_one_test("",              TEST_TXT_FILE);
+    mmap_reader_window = default_window;
+    line_reader_one_test(text, TEST_TXT_FILE);
+    line_reader_src_init = po_file_reader_init;
+    line_reader_src_uninit = po_file_reader_uninit;
+
+    char_buffer_uninit(&contents);
+    return 0;
+}
+
+/* TEST async_reader */
+
+extern int async_reader_force_sync;
+extern int async_reader_ring_failures;
+
+static void small_async_reader_init(struct strrdr_t *reader, const char *path)
+{
+    po_async_reader_init(reader, path, 4096, 3);
+}
+
+static void async_reader_one_test(const char *file_contents,
+                                  size_t buflen,
+                                  size_t depth)
+{
+    struct strrdr_t ar;
+    ro_seg_t seg;
+    size_t offset = 0;
+    int ret;
+
+    ASSERT_EXP(util_write_file(TEST_TXT_FILE, file_contents) == 0);
+    po_async_reader_init(&ar, TEST_TXT_FILE, buflen, depth);
+    ASSERT_ZERO(strrdr_open(&ar));
+    while ((ret = strrdr_read(&ar, &seg)) > 0) {
+        ASSERT_EXP((size_t)ret == seg.size && seg.size <= buflen);
+        ASSERT_EXP(memcmp(seg.start, file_contents + offset, seg.size) == 0);
+        offset += seg.size;
+    }
+    ASSERT_EXP(ret == 0);
+    ASSERT_EXP(offset == strlen(file_contents));
+    ASSERT_EXP(strrdr_read(&ar, &seg) == 0);
+    /* synchronous reads never find their block in flight */
+    ASSERT_EXP(!async_reader_force_sync || async_reader_get_stalls(&ar) == 0);
+    po_async_reader_uninit(&ar);
+    os_unlink(TEST_TXT_FILE);
+}
+
+/* stands in for parsing which takes longer than reading the block */
+static void async_reader_slow_consume(const ro_seg_t *seg)
+{
+    volatile unsigned sum = 0;
+    size_t i;
+    int pass;
+    for (pass = 0; pass < 100; ++pass) {
+        for (i = 0; i < seg->size; ++i)
+            sum = sum * 31 + (unsigned char)seg->start[i];
+    }
+}
+
+static int test_async_reader(int argc, char **argv)
+{
+    struct strrdr_t ar;
+    struct char_buffer_t contents;
+    seg_t buf;
+    ro_seg_t seg;
+    size_t offset;
+    int pass, ret;
+    (void)argc; (void)argv;
+
+    char_buffer_init(&contents);
+    util_repeat_line_reader_str(&contents, 1000);
+    char_buffer_get(&contents, &buf);
+
+    /* the second pass exercises the synchronous fallback */
+    for (pass = 0; pass < 2; ++pass) {
+        async_reader_force_sync = pass;
+        async_reader_one_test(buf.start, 4096, 4);
+        async_reader_one_test(buf.start, 1000, 1);
+        async_reader_one_test(buf.start, ASYNC_READER_BUFLEN, ASYNC_READER_DEPTH);
+        async_reader_one_test(line_reader_str, 7, 5);
+        async_reader_one_test("", 16, 2);
+
+        line_reader_src_init = small_async_reader_init;
+        line_reader_src_uninit = po_async_reader_uninit;
+        line_reader_one_test(buf.start, TEST_TXT_FILE);
+        line_reader_one_test("abc\ndef", TEST_TXT_FILE);
+        line_reader_src_init = po_file_reader_init;
+        line_reader_src_uninit = po_file_reader_uninit;
+    }
+    async_reader_force_sync = 0;
+
+    /* a released block is submitted again right away, so that a consumer
+     * slower than the reads does not have to wait for them; how many reads
+     * still stall depends on the machine, so only the data is checked */
+    ASSERT_EXP(util_write_file(TEST_TXT_FILE, buf.start) == 0);
+    po_async_reader_init(&ar, TEST_TXT_FILE, 4096, 4);
+    ASSERT_ZERO(strrdr_open(&ar));
+    offset = 0;
+    while ((ret = strrdr_read(&ar, &seg)) > 0) {
+        ASSERT_EXP(memcmp(seg.start, buf.start + offset, seg.size) == 0);
+        offset += seg.size;
+        async_reader_slow_consume(&seg);
+    }
+    ASSERT_EXP(ret == 0 && offset == buf.size - 1);
+    po_async_reader_uninit(&ar);
+
+    /* when the ring fails, whether at open or when a released block is
+     * submitted again, the reads continue without it */
+    for (pass = 0; pass < 2; ++pass) {
+        po_async_reader_init(&ar, TEST_TXT_FILE, 1024, 4);
+        async_reader_ring_failures = pass == 0 ? 1 : 0;
+        ASSERT_ZERO(strrdr_open(&ar));
+        offset = 0;
+        while ((ret = strrdr_read(&ar, &seg)) > 0) {
+            ASSERT_EXP(memcmp(seg.start, buf.start + offset, seg.size) == 0);
+            offset += seg.size;
+            if (pass == 1 && offset == 1024)
+                async_reader_ring_failures = 3;
+        }
+        ASSERT_EXP(ret == 0 && offset == buf.size - 1);
+        po_async_reader_uninit(&ar);
+    }
+    async_reader_ring_failures = 0;
+
+    /* uninit with reads still in flight, also when the ring fails while
+     * they are waited for */
+    for (pass = 0; pass < 2; ++pass) {
+        po_async_reader_init(&ar, TEST_TXT_FILE, 1024, 8);
+        ASSERT_ZERO(strrdr_open(&ar));
+        async_reader_ring_failures = pass == 0 ? 0 : INT_MAX;
+        po_async_reader_uninit(&ar);
+    }
+    async_reader_ring_failures = 0;
+    os_unlink(TEST_TXT_FILE);
+
+    /* a missing file */
+    po_async_reader_init(&ar, TEST_TXT_FILE, 1024, 2);
+    ASSERT_EXP(strrdr_open(&ar) < 0);
+    po_async_reader_uninit(&ar);
+
+    char_buffer_uninit(&contents);
+    return 0;
+}
+
+/* TEST prefetch_reader */
+
+/* a reader that fails after producing a few blocks */
+struct failing_reader_t
+{
+    int blocks_left;
+};
+
+static int failing_reader_open(void *data)
+{
+    (void)data;
+    return 0;
+}
+
+static int failing_reader_read(void *data, ro_seg_t *seg)
+{
+    struct failing_reader_t *fr = (struct failing_reader_t *)data;
+    if (fr->blocks_left-- == 0)
+        return -1;
+    seg->start = "block";
+    seg->size = 5;
+    return 5;
+}
+
+static void failing_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    (void)data;
+    *buf = "failed";
+    *errnum = 42;
+}
+
+static size_t prefetch_depth = PREFETCH_READER_DEPTH;
+static struct strrdr_t prefetch_src;
+
+static void prefetch_file_reader_init(struct strrdr_t *reader, const char *path)
+{
+    po_file_reader_init_buflen(&prefetch_src, path, 7);
+    po_prefetch_reader_init(reader, &prefetch_src, prefetch_depth);
+}
+
+static void prefetch_file_reader_uninit(struct strrdr_t *reader)
+{
+    po_prefetch_reader_uninit(reader);
+    po_file_reader_uninit(&prefetch_src);
+}
+
+static int test_prefetch_reader(int argc, char **argv)
+{
+    struct strrdr_t src, pr;
+    struct failing_reader_t failing;
+    struct char_buffer_t contents;
+    ro_seg_t seg;
+    seg_t buf;
+    size_t i, offset = 0;
+    const char *error;
+    int errnum, ret;
+    (void)argc; (void)argv;
+
+    char_buffer_init(&contents);
+    util_repeat_line_reader_str(&contents, 1000);
+    char_buffer_get(&contents, &buf);
+
+    /* blocks come out in order */
+    ASSERT_EXP(util_write_file(TEST_TXT_FILE, buf.start) == 0);
+    po_file_reader_init_buflen(&src, TEST_TXT_FILE, 1000);
+    po_prefetch_reader_init(&pr, &src, 3);
+    ASSERT_ZERO(strrdr_open(&pr));
+    while ((ret = strrdr_read(&pr, &seg)) > 0) {
+        ASSERT_EXP(memcmp(seg.start, buf.start + offset, seg.size) == 0);
+        offset += seg.size;
+    }
+    ASSERT_EXP(ret == 0 && offset == strlen(buf.start));
+    ASSERT_EXP(strrdr_read(&pr, &seg) == 0);
+    po_prefetch_reader_uninit(&pr);
+    po_file_reader_uninit(&src);
+
+    /* stopping while the producer waits on a full ring */
+    po_file_reader_init_buflen(&src, TEST_TXT_FILE, 16);
+    po_prefetch_reader_init(&pr, &src, 2);
+    ASSERT_ZERO(strrdr_open(&pr));
+    ASSERT_EXP(strrdr_read(&pr, &seg) == 16);
+    po_prefetch_reader_uninit(&pr);
+    po_file_reader_uninit(&src);
+    os_unlink(TEST_TXT_FILE);
+
+    /* errors are passed through once they are reached */
+    failing.blocks_left = 3;
+    src.data = &failing;
+    src.open = failing_reader_open;
+    src.read = failing_reader_read;
+    src.get_error = failing_reader_get_error;
+    po_prefetch_reader_init(&pr, &src, 2);
+    ASSERT_ZERO(strrdr_open(&pr));
+    for (i = 0; i < 3; ++i)
+        ASSERT_INT(strrdr_read(&pr, &seg), 5);
+    ASSERT_EXP(strrdr_read(&pr, &seg) < 0);
+    strrdr_get_error(&pr, &error, &errnum);
+    ASSERT_EXP(errnum == 42 && strcmp(error, "failed") == 0);
+    po_prefetch_reader_uninit(&pr);
+
+    line_reader_src_init = prefetch_file_reader_init;
+    line_reader_src_uninit = prefetch_file_reader_uninit;
+    for (prefetch_depth = 1; prefetch_depth <= 4; ++prefetch_depth) {
+        line_reader_one_test(buf.start, TEST_TXT_FILE);
+        line_reader_one_test(line_reader_str, TEST_TXT_FILE);
+        line_reader_one_test("abc\ndef", TEST_TXT_FILE);
+        line_reader_one_test("", TEST_TXT_FILE);
+    }
+    line_reader_src_init = po_file_reader_init;
+    line_reader_src_uninit = po_file_reader_uninit;
+
+    char_buffer_uninit(&contents);
+    return 0;
+}
+
+/* TEST inflate_reader */
+
+/* gzip -9 of line_reader_str repeated 1000 times */
+static const unsigned char inflate_gzip_repeated[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0xed, 0xce,
+    0x39, 0x0e, 0xc0, 0x20, 0x0c, 0x04, 0xc0, 0x9e, 0xd7, 0x38, 0x17, 0x81,
+    0xff, 0x7f, 0x2c, 0x1d, 0x95, 0x21, 0x12, 0xf5, 0x74, 0x96, 0xbd, 0xf2,
+    0x4e, 0x1c, 0xe7, 0x75, 0x3f, 0xf5, 0x6d, 0xbd, 0xc4, 0x18, 0x63, 0xbd,
+    0x4c, 0xcf, 0xe5, 0x27, 0xba, 0xf3, 0x33, 0x2f, 0x0a, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64, 0x64,
+    0x64, 0x64, 0x64, 0x64, 0x64, 0xe4, 0x79, 0xd1, 0x07, 0x4b, 0x4b, 0x07,
+    0xf3, 0x38, 0xbb, 0x02, 0x00,
+};
+/* zlib level 0 of line_reader_str */
+static const unsigned char inflate_zlib_stored[] = {
+    0x78, 0x01, 0x01, 0xb3, 0x00, 0x4c, 0xff, 0x30, 0x31, 0x32, 0x33, 0x34,
+    0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x0a, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30,
+    0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x30, 0x31,
+    0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x0a, 0x30, 0x31,
+    0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30, 0x31, 0x32, 0x33,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35,
+    0x36, 0x37, 0x38, 0x39, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37,
+    0x38, 0x39, 0x0a, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38,
+    0x39, 0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30,
+    0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x30, 0x31,
+    0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x30, 0x31, 0x32, 0x33,
+    0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x30, 0x31, 0x32, 0x33, 0x34,
+    0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x66, 0x64, 0x23, 0x38,
+};
+/* zlib of "abc\ndef", in a fixed-code block */
+static const unsigned char inflate_zlib_fixed[] = {
+    0x78, 0xda, 0x4b, 0x4c, 0x4a, 0xe6, 0x4a, 0x49, 0x4d, 0x03, 0x00, 0x09,
+    0x6d, 0x02, 0x60,
+};
+/* two gzip members, of "abc\n" and "def\n" */
+static const unsigned char inflate_gzip_members[] = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4b, 0x4c,
+    0x4a, 0xe6, 0x02, 0x00, 0x4e, 0x81, 0x88, 0x47, 0x04, 0x00, 0x00, 0x00,
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x4b, 0x49,
+    0x4d, 0xe3, 0x02, 0x00, 0xbc, 0x93, 0x6e, 0x08, 0x04, 0x00, 0x00, 0x00,
+};
+
+/* decompresses the blob and returns 0 if it matches expected */
+static int inflate_one_test(const unsigned char *blob,
+                            size_t blob_size,
+                            const char *expected,
+                            size_t segment_size,
+                            size_t buflen)
+{
+    struct strrdr_t mr, ir;
+    struct char_buffer_t out;
+    seg_t out_seg;
+    ro_seg_t seg;
+    int ret, matches;
+
+    char_buffer_init(&out);
+    po_memory_reader_init(&mr, (const char *)blob, blob_size, segment_size);
+    po_inflate_reader_init(&ir, &mr, buflen);
+    ASSERT_ZERO(strrdr_open(&ir));
+    while ((ret = strrdr_read(&ir, &seg)) > 0) {
+        ASSERT_EXP(seg.size <= buflen);
+        char_buffer_append_ro_seg(&out, &seg);
+    }
+    char_buffer_get(&out, &out_seg);
+    matches = ret == 0 && out_seg.size == strlen(expected) &&
+              memcmp(out_seg.start, expected, out_seg.size) == 0;
+    po_inflate_reader_uninit(&ir);
+    po_memory_reader_uninit(&mr);
+    char_buffer_uninit(&out);
+    return matches ? 0 : -1;
+}
+
+static int test_inflate_reader(int argc, char **argv)
+{
+    static const size_t segment_sizes[] = { 0, 1, 7, 100 };
+    static const size_t buflens[] = { INFLATE_READER_MIN_BUFLEN, 5000, INFLATE_READER_BUFLEN };
+    struct strrdr_t mr, ir;
+    struct char_buffer_t repeated;
+    unsigned char corrupt[sizeof(inflate_gzip_members)];
+    seg_t buf;
+    ro_seg_t seg;
+    const char *error;
+    int errnum;
+    size_t i, j;
+    (void)argc; (void)argv;
+
+    char_buffer_init(&repeated);
+    util_repeat_line_reader_str(&repeated, 1000);
+    char_buffer_get(&repeated, &buf);
+
+    for (i = 0; i < ARRAY_SIZE(segment_sizes); ++i) {
+        for (j = 0; j < ARRAY_SIZE(buflens); ++j) {
+            ASSERT_ZERO(inflate_one_test(inflate_gzip_repeated, sizeof(inflate_gzip_repeated),
+                                         buf.start, segment_sizes[i], buflens[j]));
+            ASSERT_ZERO(inflate_one_test(inflate_zlib_stored, sizeof(inflate_zlib_stored),
+                                         line_reader_str, segment_sizes[i], buflens[j]));
+            ASSERT_ZERO(inflate_one_test(inflate_zlib_fixed, sizeof(inflate_zlib_fixed),
+                                         "abc\ndef", segment_sizes[i], buflens[j]));
+            ASSERT_ZERO(inflate_one_test(inflate_gzip_members, sizeof(inflate_gzip_members),
+                                         "abc\ndef\n", segment_sizes[i], buflens[j]));
+        }
+    }
+
+    /* the line reader stacks on top */
+    po_memory_reader_init(&mr, (const char *)inflate_gzip_repeated,
+                          sizeof(inflate_gzip_repeated), 64);
+    po_inflate_reader_init(&ir, &mr, INFLATE_READER_MIN_BUFLEN);
+    ASSERT_ZERO(line_reader_check(&ir, buf.start));
+    po_inflate_reader_uninit(&ir);
+    po_memory_reader_uninit(&mr);
+
+    /* a damaged CRC of the second member */
+    memcpy(corrupt, inflate_gzip_members, sizeof(corrupt));
+    corrupt[sizeof(corrupt) - 8] ^= 1;
+    ASSERT_EXP(inflate_one_test(corrupt, sizeof(corrupt), "abc\ndef\n", 0,
+                                INFLATE_READER_BUFLEN) < 0);
+
+    /* truncated input, and input which is not compressed */
+    ASSERT_EXP(inflate_one_test(inflate_gzip_repeated, sizeof(inflate_gzip_repeated) - 10,
+                                buf.start, 0, INFLATE_READER_BUFLEN) < 0);
+    po_memory_reader_init(&mr, line_reader_str, strlen(line_reader_str), 0);
+    po_inflate_reader_init(&ir, &mr, INFLATE_READER_BUFLEN);
+    ASSERT_ZERO(strrdr_open(&ir));
+    ASSERT_EXP(strrdr_read(&ir, &seg) < 0);
+    strrdr_get_error(&ir, &error, &errnum);
+    ASSERT_EXP(*error != '\0');
+    po_inflate_reader_uninit(&ir);
+    po_memory_reader_uninit(&mr);
+
+    char_buffer_uninit(&repeated);
+    return 0;
+}
+
+/* TEST lz4 */
+
+/* lz4 -BD -BX -B4 of line_reader_str repeated 1000 times, i.e. linked 64 KB
+ * blocks with block checksums */
+static const unsigned char lz4_linked_repeated[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x54, 0x40, 0xae, 0x44, 0x01, 0x00, 0x00, 0xb6,
+    0x30, 0x31, 0x32, 0x33, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x0a, 0x0b,
+    0x00, 0x06, 0x0a, 0x00, 0x0f, 0x15, 0x00, 0x02, 0x0f, 0x1f, 0x00, 0x02,
+    0x1f, 0x0a, 0x2b, 0x00, 0x0c, 0x0f, 0x35, 0x00, 0x02, 0x06, 0x15, 0x00,
+    0x06, 0x0a, 0x00, 0x0f, 0x48, 0x00, 0x02, 0x07, 0x15, 0x00, 0x0f, 0x0b,
+    0x00, 0x03, 0x0f, 0x40, 0x00, 0x0c, 0x0f, 0x1f, 0x00, 0x02, 0x0f, 0xb3,
+    0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xeb, 0x50, 0x36, 0x37, 0x38, 0x39, 0x30, 0x17,
+    0x91, 0x0e, 0xe0, 0x0e, 0x01, 0x00, 0x00, 0x0f, 0xff, 0xff, 0x0b, 0x0f,
+    0x37, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xca, 0x50, 0x37, 0x38, 0x39, 0x30,
+    0x31, 0x12, 0xa7, 0x11, 0x27, 0xc5, 0x00, 0x00, 0x00, 0x0f, 0xea, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+    0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xdb, 0x50, 0x36, 0x37, 0x38,
+    0x39, 0x0a, 0xe9, 0x7f, 0x37, 0x50, 0x00, 0x00, 0x00, 0x00, 0x98, 0x57,
+    0x07, 0xa3,
+};
+/* frames of "abc\n" and "def\n" from lz4, with a skippable frame between */
+static const unsigned char lz4_frames[] = {
+    0x04, 0x22, 0x4d, 0x18, 0x64, 0x40, 0xa7, 0x04, 0x00, 0x00, 0x80, 0x61,
+    0x62, 0x63, 0x0a, 0x00, 0x00, 0x00, 0x00, 0x6c, 0x3e, 0x7b, 0x08, 0x50,
+    0x2a, 0x4d, 0x18, 0x03, 0x00, 0x00, 0x00, 0x78, 0x79, 0x7a, 0x04, 0x22,
+    0x4d, 0x18, 0x64, 0x40, 0xa7, 0x04, 0x00, 0x00, 0x80, 0x64, 0x65, 0x66,
+    0x0a, 0x00, 0x00, 0x00, 0x00, 0xde, 0xdf, 0x19, 0x00,
+};
+
+/* decompresses the blob and returns 0 if it matches expected */
+static int lz4_one_test(const unsigned char *blob,
+                        size_t blob_size,
+                        const char *expected,
+                        size_t segment_size)
+{
+    struct strrdr_t mr, lr;
+    struct char_buffer_t out;
+    seg_t out_seg;
+    ro_seg_t seg;
+    int ret, matches;
+
+    char_buffer_init(&out);
+    po_memory_reader_init(&mr, (const char *)blob, blob_size, segment_size);
+    po_lz4_reader_init(&lr, &mr);
+    ASSERT_ZERO(strrdr_open(&lr));
+    while ((ret = strrdr_read(&lr, &seg)) > 0)
+        char_buffer_append_ro_seg(&out, &seg);
+    char_buffer_get(&out, &out_seg);
+    matches = ret == 0 && out_seg.size == strlen(expected) &&
+              memcmp(out_seg.start, expected, out_seg.size) == 0;
+    po_lz4_reader_uninit(&lr);
+    po_memory_reader_uninit(&mr);
+    char_buffer_uninit(&out);
+    return matches ? 0 : -1;
+}
+
+static int test_lz4(int argc, char **argv)
+{
+    static const size_t segment_sizes[] = { 0, 1, 7, 100 };
+    static const size_t block_sizes[] = { LZ4_WRITER_BLOCK_SIZE, 256 * 1024 };
+    const size_t data_size = 300000;
+    struct lz4_state_t state;
+    struct strrdr_t fr, lr;
+    struct strwtr_t fw, lw;
+    struct char_buffer_t repeated;
+    unsigned char corrupt[sizeof(lz4_frames)];
+    char *data, *packed, *unpacked;
+    unsigned rand_state = 1;
+    seg_t buf;
+    ro_seg_t seg;
+    const char *error;
+    int errnum, ret;
+    size_t i, j, size;
+    (void)argc; (void)argv;
+
+    char_buffer_init(&repeated);
+    util_repeat_line_reader_str(&repeated, 1000);
+    char_buffer_get(&repeated, &buf);
+
+    /* frames made by the lz4 tool */
+    for (i = 0; i < ARRAY_SIZE(segment_sizes); ++i) {
+        ASSERT_ZERO(lz4_one_test(lz4_linked_repeated, sizeof(lz4_linked_repeated),
+                                 buf.start, segment_sizes[i]));
+        ASSERT_ZERO(lz4_one_test(lz4_frames, sizeof(lz4_frames),
+                                 "abc\ndef\n", segment_sizes[i]));
+    }
+
+    /* the first half of the data compresses well, the rest not at all */
+    data = (char *)malloc(data_size);
+    packed = (char *)malloc(lz4_compress_bound(data_size));
+    unpacked = (char *)malloc(data_size);
+    memcpy(data, buf.start, data_size / 2);
+    for (i = data_size / 2; i < data_size; ++i) {
+        rand_state = rand_state * 1103515245 + 12345;
+        data[i] = (char)(rand_state >> 16);
+    }
+
+    /* blocks of all kinds of sizes make it back */
+    for (i = 0; i <= data_size; i = i * 3 + 1) {
+        for (j = 0; j + i <= data_size; j += data_size / 4) {
+            seg.start = data + j;
+            seg.size = i;
+            size = lz4_compress(&state, &seg, packed);
+            ASSERT_EXP(size <= lz4_compress_bound(i));
+            seg.start = packed;
+            seg.size = size;
+            ASSERT_EXP(lz4_decompress(&seg, unpacked, i) == (int)i);
+            ASSERT_ZERO(memcmp(unpacked, data + j, i));
+            if (i > 0)
+                ASSERT_EXP(lz4_decompress(&seg, unpacked, i - 1) < 0);
+        }
+    }
+    seg.start = data;
+    seg.size = data_size / 2;
+    ASSERT_EXP(lz4_compress(&state, &seg, packed) < data_size / 20);
+
+    /* frames through a file, written in pieces of all sizes */
+    for (i = 0; i < ARRAY_SIZE(block_sizes); ++i) {
+        po_file_writer_init(&fw, TEST_TXT_FILE);
+        po_lz4_writer_init(&lw, &fw, block_sizes[i]);
+        ASSERT_ZERO(strwtr_open(&lw));
+        for (j = 0, size = 1; j < data_size; j += seg.size, size *= 3) {
+            seg.start = data + j;
+            seg.size = size % 100000 < data_size - j ? size % 100000 : data_size - j;
+            ASSERT_ZERO(strwtr_write(&lw, &seg));
+            if (j == 0)
+                ASSERT_ZERO(strwtr_flush(&lw));  /* a short block */
+        }
+        ASSERT_ZERO(po_lz4_writer_finish(&lw));
+        po_lz4_writer_uninit(&lw);
+        po_file_writer_uninit(&fw);
+
+        po_file_reader_init_buflen(&fr, TEST_TXT_FILE, 1000);
+        po_lz4_reader_init(&lr, &fr);
+        ASSERT_ZERO(strrdr_open(&lr));
+        for (j = 0; (ret = strrdr_read(&lr, &seg)) > 0; j += seg.size) {
+            ASSERT_EXP(seg.size <= block_sizes[i] && j + seg.size <= data_size);
+            ASSERT_ZERO(memcmp(seg.start, data + j, seg.size));
+        }
+        ASSERT_EXP(ret == 0 && j == data_size);
+        po_lz4_reader_uninit(&lr);
+        po_file_reader_uninit(&fr);
+    }
+    os_unlink(TEST_TXT_FILE);
+
+    /* the line reader stacks on top */
+    po_memory_reader_init(&fr, (const char *)lz4_linked_repeated,
+                          sizeof(lz4_linked_repeated), 64);
+    po_lz4_reader_init(&lr, &fr);
+    ASSERT_ZERO(line_reader_check(&lr, buf.start));
+    po_lz4_reader_uninit(&lr);
+    po_memory_reader_uninit(&fr);
+
+    /* a damaged content checksum of the second frame */
+    memcpy(corrupt, lz4_frames, sizeof(corrupt));
+    corrupt[sizeof(corrupt) - 1] ^= 1;
+    ASSERT_EXP(lz4_one_test(corrupt, sizeof(corrupt), "abc\ndef\n", 0) < 0);
+
+    /* truncated input, and input which is not compressed */
+    ASSERT_EXP(lz4_one_test(lz4_linked_repeated, sizeof(lz4_linked_repeated) - 10,
+                            buf.start, 0) < 0);
+    po_memory_reader_init(&fr, line_reader_str, strlen(line_reader_str), 0);
+    po_lz4_reader_init(&lr, &fr);
+    ASSERT_ZERO(strrdr_open(&lr));
+    ASSERT_EXP(strrdr_read(&lr, &seg) < 0);
+    strrdr_get_error(&lr, &error, &errnum);
+    ASSERT_EXP(*error != '\0');
+    po_lz4_reader_uninit(&lr);
+    po_memory_reader_uninit(&fr);
+
+    free(data);
+    free(packed);
+    free(unpacked);
+    char_buffer_uninit(&repeated);
+    return 0;
+}
+
+/* TEST file_split */
+
+struct split_worker_t
+{
+    const char *path;
+    uint64_t begin;
+    uint64_t end;
+    size_t lines;
+    uint64_t bytes;
+    int error;
+};
+
+static void split_worker_run(void *arg)
+{
+    struct split_worker_t *w = (struct split_worker_t *)arg;
+    struct strrdr_t fr, lr;
+    ro_seg_t seg;
+    int ret;
+
+    po_file_reader_init_range(&fr, w->path, w->begin, w->end, 64);
+    po_line_reader_init(&lr, &fr);
+    if ((ret = strrdr_open(&lr)) == 0) {
+        while ((ret = strrdr_read(&lr, &seg)) > 0) {
+            if (seg.start[seg.size-1] == '\n')
+                ++w->lines;
+            w->bytes += seg.size;
+        }
+    }
+    w->error = ret < 0;
+    po_line_reader_uninit(&lr);
+    po_file_reader_uninit(&fr);
+}
+
+static void file_split_one_test(const char *file_contents, size_t n)
+{
+    uint64_t bounds[9];
+    struct split_worker_t workers[8];
+    thread_t threads[8];
+    size_t i, lines = 0;
+    uint64_t bytes = 0;
+    int errnum;
+
+    ASSERT_EXP(n <= ARRAY_SIZE(workers));
+    ASSERT_EXP(util_write_file(TEST_TXT_FILE, file_contents) == 0);
+    ASSERT_ZERO(file_split_lines(TEST_TXT_FILE, bounds, n, &errnum));
+    ASSERT_EXP(bounds[0] == 0 && bounds[n] == strlen(file_contents));
+
+    for (i = 0; i < n; ++i) {
+        ASSERT_EXP(bounds[i] <= bounds[i+1]);
+        ASSERT_EXP(bounds[i] == 0 || bounds[i] == bounds[n] ||
+                   file_contents[bounds[i]-1] == '\n');
+        workers[i].path = TEST_TXT_FILE;
+        workers[i].begin = bounds[i];
+        workers[i].end = bounds[i+1];
+        workers[i].lines = 0;
+        workers[i].bytes = 0;
+        ASSERT_ZERO(thread_create(&threads[i], split_worker_run, &workers[i]));
+    }
+
+    for (i = 0; i < n; ++i) {
+        thread_join(&threads[i]);
+        ASSERT_EXP(!workers[i].error);
+        ASSERT_EXP(workers[i].bytes == workers[i].end - workers[i].begin);
+        lines += workers[i].lines;
+        bytes += workers[i].bytes;
+    }
+    ASSERT_EXP(lines == util_count_chars(file_contents, '\n'));
+    ASSERT_EXP(bytes == strlen(file_contents));
+
+    os_unlink(TEST_TXT_FILE);
+}
+
+static int test_file_split(int argc, char **argv)
+{
+    struct char_buffer_t contents;
+    seg_t buf;
+    uint64_t bounds[2];
+    int errnum;
+    (void)argc; (void)argv;
+
+    char_buffer_init(&contents);
+    util_repeat_line_reader_str(&contents, 100);
+    char_buffer_get(&contents, &buf);
+
+    file_split_one_test(buf.start, 1);
+    file_split_one_test(buf.start, 7);
+    file_split_one_test(buf.start, 8);
+    file_split_one_test(line_reader_str, 8);
+    file_split_one_test("abc\ndef", 4);
+    file_split_one_test("0123456789\n", 8);
+    file_split_one_test("", 3);
+
+    /* a missing file */
+    ASSERT_EXP(file_split_lines(TEST_TXT_FILE, bounds, 1, &errnum) < 0);
+    ASSERT_EXP(errnum != 0);
+
+    char_buffer_uninit(&contents);
+    return 0;
+}
+
+/* TEST strarray */
+
+static int test_strarray(int argc, char **argv)
+{
+    strarray_t arr;
+    seg_t seg;
+    int i;
+    (void)argc; (void)argv;
+
+    strarray_init(&arr, sizeof(int), 1);
+    for (i = 0; i < 100; ++i)
+        strarray_append(&arr, &i, 1);
+    ASSERT_EXP(strarray_size(&arr) == 100);
+    ASSERT_EXP(strarray_capacity(&arr) >= 100);
+
+    /* a pre-sized array does not move while appending */
+    strarray_reserve(&arr, 1000);
+    ASSERT_EXP(strarray_capacity(&arr) >= 1000);
+    strarray_get_strref(&arr, &seg);
+    {
+        char * const start = seg.start;
+        for (i = 100; i < 1000; ++i)
+            strarray_append(&arr, &i, 1);
+        strarray_get_strref(&arr, &seg);
+        ASSERT_EXP(seg.start == start);
+    }
+
+    strarray_pop_front(&arr, 990);
+    strarray_shrink_to_fit(&arr);
+    ASSERT_EXP(strarray_capacity(&arr) == 10);
+    strarray_get_strref(&arr, &seg);
+    ASSERT_EXP(seg.size == 10);
+    for (i = 0; i < 10; ++i)
+        ASSERT_EXP(((int *)seg.start)[i] == 990 + i);
+
+    /* a single large append grows straight to the needed size */
+    {
+        int big[100];
+        memset(big, 0, sizeof(big));
+        strarray_append(&arr, big, ARRAY_SIZE(big));
+        ASSERT_EXP(strarray_size(&arr) == 110);
+        ASSERT_EXP(strarray_capacity(&arr) == 110);
+    }
+
+    strarray_uninit(&arr);
+    return 0;
+}
+
+/* TEST vec */
+
+DEFINE_VEC(int_vec, int)
+DEFINE_VEC(seg_vec, ro_seg_t)
+
+static int test_vec(int argc, char **argv)
+{
+    int_vec_t ints;
+    seg_vec_t segs;
+    struct arena_t arena;
+    ro_seg_t seg;
+    int i;
+    (void)argc; (void)argv;
+
+    int_vec_init(&ints);
+    for (i = 0; i < 1000; ++i)
+        int_vec_push_back(&ints, i);
+    ASSERT_EXP(int_vec_size(&ints) == 1000);
+    for (i = 0; i < 1000; ++i)
+        ASSERT_EXP(*int_vec_at(&ints, i) == i);
+    ASSERT_EXP(int_vec_pop_back(&ints) == 999);
+    ASSERT_EXP(*int_vec_back(&ints) == 998);
+    int_vec_clear(&ints);
+    ASSERT_EXP(int_vec_size(&ints) == 0);
+    int_vec_uninit(&ints);
+
+    arena_init(&arena, 1024);
+    seg_vec_init_alloc(&segs, arena_allocator(&arena));
+    seg_vec_reserve(&segs, 4);
+    ASSERT_EXP(segs.capacity == 4);
+    for (i = 0; i < 100; ++i) {
+        ro_seg_set_static(&seg, "abc");
+        ro_seg_trim_front(&seg, i % 4);
+        seg_vec_push_back(&segs, seg);
+    }
+    for (i = 0; i < 100; ++i)
+        ASSERT_EXP(seg_vec_at(&segs, i)->size == 3 - (size_t)(i % 4));
+    seg_vec_uninit(&segs);
+    arena_uninit(&arena);
+
+    return 0;
+}
+
+/* TEST char_buffer */
+
+static int char_buffer_equals(struct char_buffer_t *cb, const char *str)
+{
+    seg_t seg;
+    char_buffer_get(cb, &seg);
+    return seg.size == strlen(str) &&
+        memcmp(seg.start, str, seg.size) == 0 &&
+        seg.start[seg.size] == '\0';
+}
+
+static int test_char_buffer(int argc, char **argv)
+{
+    struct char_buffer_t cb;
+    size_t i;
+    (void)argc; (void)argv;
+
+    char_buffer_init(&cb);
+    ASSERT_EXP(char_buffer_size(&cb) == 0);
+    ASSERT_EXP(char_buffer_equals(&cb, ""));
+
+    char_buffer_append(&cb, "abc\ndef\n", 8);
+    ASSERT_EXP(char_buffer_equals(&cb, "abc\ndef\n"));
+    char_buffer_pop_front(&cb, 4);
+    ASSERT_EXP(char_buffer_equals(&cb, "def\n"));
+    char_buffer_append(&cb, "ghi", 3);
+    ASSERT_EXP(char_buffer_equals(&cb, "def\nghi"));
+    char_buffer_pop_front(&cb, 7);
+    ASSERT_EXP(char_buffer_equals(&cb, ""));
+    char_buffer_set(&cb, "xyz", 3);
+    ASSERT_EXP(char_buffer_equals(&cb, "xyz"));
+
+    /* short contents stay in the inline storage, longer ones move out */
+    {
+        seg_t seg;
+        char_buffer_get(&cb, &seg);
+        ASSERT_EXP(seg.start == cb.inline_buf);
+        for (i = 3; i < CHAR_BUFFER_INLINE_CAPACITY - 1; ++i)
+            char_buffer_append(&cb, "x", 1);
+        char_buffer_get(&cb, &seg);
+        ASSERT_EXP(seg.start == cb.inline_buf);
+        char_buffer_append(&cb, "yz", 2);
+        char_buffer_get(&cb, &seg);
+        ASSERT_EXP(seg.start != cb.inline_buf);
+        ASSERT_EXP(seg.size == CHAR_BUFFER_INLINE_CAPACITY + 1);
+        ASSERT_EXP(memcmp(seg.start, "xyzxx", 5) == 0);
+        ASSERT_EXP(memcmp(seg.start + seg.size - 3, "xyz", 4) == 0);
+    }
+
+    /* interleave pops and appends so that the buffer has to reclaim the
+     * popped space and grow while partially drained */
+    char_buffer_clear(&cb);
+    for (i = 0; i < 1000; ++i) {
+        char_buffer_append(&cb, "0123456789", 10);
+        char_buffer_pop_front(&cb, 9);
+        ASSERT_EXP(char_buffer_size(&cb) == i + 1);
+    }
+    {
+        seg_t seg;
+        char_buffer_get(&cb, &seg);
+        /* what remains is the tail of "0123456789" repeated */
+        for (i = 0; i < seg.size; ++i)
+            ASSERT_EXP(seg.start[i] == '9' - (char)((seg.size - 1 - i) % 10));
+        ASSERT_EXP(seg.start[seg.size] == '\0');
+    }
+
+    /* single-char and unchecked appends */
+    char_buffer_clear(&cb);
+    for (i = 0; i < 1000; ++i)
+        char_buffer_push_char(&cb, (char)('a' + i % 26));
+    ASSERT_EXP(char_buffer_size(&cb) == 1000);
+    char_buffer_pop_front(&cb, 997);
+    ASSERT_EXP(char_buffer_equals(&cb, "jkl"));
+    char_buffer_reserve(&cb, 4);
+    char_buffer_push_char_unchecked(&cb, 'm');
+    char_buffer_append_unchecked(&cb, "nop", 3);
+    ASSERT_EXP(char_buffer_equals(&cb, "jklmnop"));
+
+    char_buffer_uninit(&cb);
+    return 0;
+}
+
+/* TEST arena */
+
+static int test_arena(int argc, char **argv)
+{
+    struct arena_t arena;
+    struct char_buffer_t cb;
+    char *first, *ptr;
+    size_t i;
+    (void)argc; (void)argv;
+
+    arena_init(&arena, 256);
+
+    first = (char *)arena_alloc(&arena, 3);
+    ASSERT_EXP(first != NULL);
+    ptr = (char *)arena_alloc(&arena, 5);
+    ASSERT_EXP(ptr > first);
+    ASSERT_EXP(((size_t)ptr & (sizeof(void *) - 1)) == 0);
+
+    /* the most recent allocation is given back */
+    arena_free(&arena, ptr, 5);
+    ASSERT_EXP((char *)arena_alloc(&arena, 5) == ptr);
+
+    /* shrinking an older allocation neither moves it nor takes more space */
+    {
+        char *const next = (char *)arena_alloc(&arena, 1);
+        ASSERT_EXP((char *)arena_realloc(&arena, first, 3, 1) == first);
+        ASSERT_EXP((char *)arena_realloc(&arena, ptr, 5, 5) == ptr);
+        arena_free(&arena, next, 1);
+        ASSERT_EXP((char *)arena_alloc(&arena, 1) == next);
+    }
+
+    /* allocations larger than the block size get their own block */
+    ptr = (char *)arena_alloc(&arena, 1000);
+    ASSERT_EXP(ptr != NULL);
+    memset(ptr, 'x', 1000);
+
+    /* char_buffer_t bound to the arena */
+    char_buffer_init_alloc(&cb, arena_allocator(&arena));
+    for (i = 0; i < 100; ++i)
+        char_buffer_append(&cb, "0123456789", 10);
+    ASSERT_EXP(char_buffer_size(&cb) == 1000);
+    {
+        seg_t seg;
+        char_buffer_get(&cb, &seg);
+        ASSERT_EXP(memcmp(seg.start + 990, "0123456789", 11) == 0);
+    }
+    char_buffer_uninit(&cb);
+
+    /* the blocks are reused after a reset */
+    arena_reset(&arena);
+    ASSERT_EXP((char *)arena_alloc(&arena, 3) == first);
+
+    arena_uninit(&arena);
+    return 0;
+}
+
+/* TEST rope */
+
+static int test_rope(int argc, char **argv)
+{
+    struct rope_t rope;
+    struct rope_iter_t iter;
+    ro_seg_t piece;
+    seg_t whole;
+    size_t i, pieces = 0, total = 0;
+    (void)argc; (void)argv;
+
+    rope_init(&rope, 16);
+    rope_linearize(&rope, &whole);
+    ASSERT_EXP(whole.size == 0);
+
+    for (i = 0; i < 10; ++i)
+        rope_append(&rope, "0123456789", 10);
+    ASSERT_EXP(rope_size(&rope) == 100);
+
+    /* 100 bytes in chunks of 16 */
+    rope_iter_init(&iter, &rope);
+    while (rope_iter_next(&iter, &piece)) {
+        ASSERT_EXP(memcmp(piece.start, "0123456789012345678901234567890" + total % 10,
+                          piece.size) == 0);
+        total += piece.size;
+        ++pieces;
+    }
+    ASSERT_EXP(pieces == 7 && total == 100);
+
+    rope_linearize(&rope, &whole);
+    ASSERT_EXP(whole.size == 100);
+    for (i = 0; i < 100; ++i)
+        ASSERT_EXP(whole.start[i] == (char)('0' + i % 10));
+
+    /* appending after linearizing adds chunks behind the contiguous one */
+    rope_append(&rope, "abc", 3);
+    rope_iter_init(&iter, &rope);
+    ASSERT_EXP(rope_iter_next(&iter, &piece) && piece.size == 100);
+    ASSERT_EXP(rope_iter_next(&iter, &piece) && piece.size == 3);
+    ASSERT_EXP(!rope_iter_next(&iter, &piece));
+
+    rope_clear(&rope);
+    ASSERT_EXP(rope_size(&rope) == 0);
+    rope_iter_init(&iter, &rope);
+    ASSERT_EXP(!rope_iter_next(&iter, &piece));
+
+    rope_uninit(&rope);
+    return 0;
+}
+
+/* TEST shared */
+
+static int test_shared(int argc, char **argv)
+{
+    struct shared_buf_t *buf;
+    struct shared_slice_t line, word, tail;
+    seg_t contents;
+    ro_seg_t seg;
+    str_t str;
+    (void)argc; (void)argv;
+
+    buf = shared_buf_new(11, NULL);
+    shared_buf_get(buf, &contents);
+    memcpy(contents.start, "hello world", 11);
+
+    shared_slice_init(&line, buf, 0, 11);
+    shared_buf_unref(buf);  /* now only the slices keep it alive */
+    ASSERT_EXP(buf->refcount == 1);
+
+    shared_slice_sub(&word, &line, 6, 5);
+    shared_slice_sub(&tail, &word, 1, 4);
+    ASSERT_EXP(buf->refcount == 3);
+    shared_slice_release(&line);
+    shared_slice_release(&word);
+    shared_slice_release(&word);  /* releasing twice is harmless */
+    ASSERT_EXP(buf->refcount == 1);
+
+    shared_slice_get(&tail, &seg);
+    ASSERT_EXP(seg.size == 4 && memcmp(seg.start, "orld", 4) == 0);
+    shared_slice_release(&tail);
+
+    /* taking over a str_t does not copy its contents */
+    str_init(&str, 3);
+    memcpy(str.start, "abc", 3);
+    contents.start = str.start;
+    buf = shared_buf_take_str(&str);
+    ASSERT_EXP(str.start == NULL);
+    shared_slice_init(&line, buf, 1, 2);
+    shared_buf_unref(buf);
+    shared_slice_get(&line, &seg);
+    ASSERT_EXP(seg.start == contents.start + 1);
+    shared_slice_release(&line);
 
     return 0;
 }
@@ -418,6 +1955,319 @@ static int test_bintree(int argc, char **argv)
     return 0;
 }
 
+/* TEST scan */
+
+static void scan_one_test(const char *buf, size_t size)
+{
+    static const char set[] = { '"', '\\', '\n' };
+    ro_seg_t seg;
+    size_t i, expected_count = 0, expected_find = size;
+    size_t expected_first_of = size, expected_non_digit = size;
+
+    seg.start = buf;
+    seg.size = size;
+
+    for (i = size; i-- > 0; ) {
+        if (buf[i] == '\n') {
+            ++expected_count;
+            expected_find = i;
+        }
+        if (memchr(set, buf[i], sizeof(set)) != NULL)
+            expected_first_of = i;
+        if (buf[i] < '0' || buf[i] > '9')
+            expected_non_digit = i;
+    }
+
+    ASSERT_EXP(ro_seg_find_byte(&seg, '\n') == expected_find);
+    ASSERT_EXP(ro_seg_count_byte(&seg, '\n') == expected_count);
+    ASSERT_EXP(ro_seg_find_first_of(&seg, set, sizeof(set)) == expected_first_of);
+    ASSERT_EXP(ro_seg_find_non_digit(&seg) == expected_non_digit);
+}
+
+static int test_scan(int argc, char **argv)
+{
+    static const enum scan_isa_t isas[] = {
+        SCAN_ISA_PORTABLE, SCAN_ISA_SSE2, SCAN_ISA_AVX2
+    };
+    const enum scan_isa_t orig_isa = scan_get_isa();
+    char buf[300];
+    unsigned i, j, round;
+    (void)argc; (void)argv;
+
+    for (i = 0; i < ARRAY_SIZE(isas); ++i) {
+        if (scan_set_isa(isas[i]))
+            continue;  /* not supported by the CPU */
+
+        for (round = 0; round < 200; ++round) {
+            /* mostly digits, with some of the searched-for bytes and bytes
+             * above 0x7f sprinkled in */
+            for (j = 0; j < sizeof(buf); ++j) {
+                const size_t r = get_rand(100);
+                buf[j] = r < 2 ? '\n' : r < 3 ? '"' : r < 4 ? (char)0xb0 :
+                         r < 5 ? '/' : (char)('0' + r % 10);
+            }
+            for (j = 0; j < 70; ++j)
+                scan_one_test(buf + j, sizeof(buf) - 2 * j);
+        }
+
+        /* long runs without matches, to exercise the lane counters */
+        memset(buf, '\n', sizeof(buf));
+        scan_one_test(buf, sizeof(buf));
+        memset(buf, '7', sizeof(buf));
+        scan_one_test(buf, sizeof(buf));
+    }
+    {
+        static char big[16 * 300];
+        memset(big, '\n', sizeof(big));
+        for (i = 0; i < ARRAY_SIZE(isas); ++i) {
+            if (scan_set_isa(isas[i]) == 0)
+                scan_one_test(big, sizeof(big));
+        }
+    }
+
+    scan_set_isa(orig_isa);
+    return 0;
+}
+
+/* TEST hash */
+
+static int test_hash(int argc, char **argv)
+{
+    /* reference XXH64 values */
+    static const struct {
+        const char *str;
+        uint64_t seed;
+        uint64_t hash;
+    } known[] = {
+        { "", 0, 0xEF46DB3751D8E999ULL },
+        { "a", 0, 0xD24EC4F1A98C6E5BULL },
+        { "abc", 0, 0x44BC2CF5AD770999ULL },
+    };
+    char buf[200];
+    unsigned i, j, k;
+    (void)argc; (void)argv;
+
+    for (i = 0; i < ARRAY_SIZE(known); ++i) {
+        ASSERT_EXP(hash64(known[i].str, strlen(known[i].str), known[i].seed) ==
+                   known[i].hash);
+    }
+    /* long enough to go through the 32-byte stripes */
+    for (i = 0; i < 100; ++i)
+        buf[i] = (char)('0' + i % 10);
+    ASSERT_EXP(hash64(buf, 100, 0) == 0xF80E7B96315AFFFAULL);
+
+    for (i = 0; i < sizeof(buf); ++i)
+        buf[i] = (char)get_rand(256);
+
+    /* the seed matters */
+    ASSERT_EXP(hash64(buf, sizeof(buf), 0) != hash64(buf, sizeof(buf), 1));
+
+    /* incremental hashing matches the one-shot for any split of the data */
+    for (i = 0; i <= sizeof(buf); i += 7) {
+        for (j = 1; j < 70; j += 3) {
+            struct hash_state_t state;
+            ro_seg_t chunk;
+            hash_state_init(&state, 42);
+            for (k = 0; k < i; k += j) {
+                chunk.start = buf + k;
+                chunk.size = i - k < j ? i - k : j;
+                hash_state_update(&state, &chunk);
+            }
+            ASSERT_EXP(hash_state_final(&state) == hash64(buf, i, 42));
+        }
+    }
+
+    /* reference XXH32 values, and the same checks for its incremental form */
+    ASSERT_EXP(hash32("", 0, 0) == 0x02CC5D05);
+    ASSERT_EXP(hash32("a", 1, 0) == 0x550D7456);
+    ASSERT_EXP(hash32("abc", 3, 0) == 0x32D153FF);
+    ASSERT_EXP(hash32("Nobody inspects the spammish repetition", 39, 0) == 0xE2293B2F);
+    ASSERT_EXP(hash32(buf, sizeof(buf), 0) != hash32(buf, sizeof(buf), 1));
+    for (i = 0; i <= sizeof(buf); i += 7) {
+        for (j = 1; j < 40; j += 3) {
+            struct hash32_state_t state;
+            ro_seg_t chunk;
+            hash32_state_init(&state, 42);
+            for (k = 0; k < i; k += j) {
+                chunk.start = buf + k;
+                chunk.size = i - k < j ? i - k : j;
+                hash32_state_update(&state, &chunk);
+            }
+            ASSERT_EXP(hash32_state_final(&state) == hash32(buf, i, 42));
+        }
+    }
+
+    return 0;
+}
+
+/* TEST intern */
+
+static int test_intern(int argc, char **argv)
+{
+    intern_table_t table;
+    intern_cache_t *cache;
+    ro_seg_t key;
+    const intern_str_t *abc, *abd;
+    char buf[16];
+    unsigned i;
+    (void)argc; (void)argv;
+
+    intern_table_init(&table);
+
+    ro_seg_set_static(&key, "abc");
+    ASSERT_EXP(intern_table_find(&table, &key) == NULL);
+    abc = intern_table_intern(&table, &key);
+    ASSERT_EXP(abc->size == 3 && strcmp(abc->start, "abc") == 0);
+    ASSERT_EXP(abc->hash == intern_hash(&key));
+
+    /* equal contents at a different address map to the same handle */
+    memcpy(buf, "xabcx", 6);
+    key.start = buf + 1;
+    key.size = 3;
+    ASSERT_EXP(intern_table_find(&table, &key) == abc);
+    ASSERT_EXP(intern_table_intern(&table, &key) == abc);
+    ASSERT_EXP(intern_table_size(&table) == 1);
+
+    ro_seg_set_static(&key, "abd");
+    abd = intern_table_intern(&table, &key);
+    ASSERT_EXP(abd != abc);
+
+    /* grow the table well past its initial capacity */
+    for (i = 0; i < 5000; ++i) {
+        sprintf(buf, "key%u", i);
+        ro_seg_set_static(&key, buf);
+        ASSERT_EXP(intern_table_intern(&table, &key) != NULL);
+    }
+    ASSERT_EXP(intern_table_size(&table) == 5002);
+    ro_seg_set_static(&key, "abc");
+    ASSERT_EXP(intern_table_find(&table, &key) == abc);
+
+    /* the front cache returns the handles of the shared table */
+    cache = (intern_cache_t *)malloc(sizeof(intern_cache_t));
+    intern_cache_init(cache, &table);
+    for (i = 0; i < 2; ++i) {
+        ro_seg_set_static(&key, "abc");
+        ASSERT_EXP(intern_cache_intern(cache, &key) == abc);
+        ro_seg_set_static(&key, "key42");
+        ASSERT_EXP(intern_cache_intern(cache, &key) ==
+                   intern_table_find(&table, &key));
+        ro_seg_set_static(&key, "new");
+        ASSERT_EXP(intern_cache_intern(cache, &key) ==
+                   intern_table_find(&table, &key));
+    }
+    ASSERT_EXP(intern_table_size(&table) == 5003);
+    free(cache);
+
+    intern_table_uninit(&table);
+    return 0;
+}
+
+/* TEST utf8 */
+
+/* validates buf in chunks of chunk_size bytes */
+static int utf8_chunked_is_valid(const char *buf, size_t size, size_t chunk_size)
+{
+    struct utf8_state_t state;
+    ro_seg_t chunk;
+    size_t i;
+
+    utf8_state_init(&state);
+    for (i = 0; i < size; i += chunk_size) {
+        chunk.start = buf + i;
+        chunk.size = size - i < chunk_size ? size - i : chunk_size;
+        if (utf8_validate(&state, &chunk))
+            return 0;
+    }
+    return utf8_state_is_complete(&state);
+}
+
+static size_t utf8_append_random_char(char *buf)
+{
+    static const char * const chars[] = {
+        "a", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x98\x80", "\xed\x9f\xbf",
+        "\xf4\x8f\xbf\xbf", "\xef\xbf\xbf", "\xc2\x80", "\xe0\xa0\x80",
+    };
+    const size_t r = get_rand(4 * ARRAY_SIZE(chars));
+    const char *c = r < ARRAY_SIZE(chars) ? chars[r] : chars[0];
+    memcpy(buf, c, strlen(c));
+    return strlen(c);
+}
+
+static int test_utf8(int argc, char **argv)
+{
+    static const enum scan_isa_t isas[] = {
+        SCAN_ISA_PORTABLE, SCAN_ISA_SSE2, SCAN_ISA_AVX2
+    };
+    static const struct {
+        const char *str;
+        int valid;
+    } known[] = {
+        { "", 1 },
+        { "plain ascii", 1 },
+        { "\xc3\xa9", 1 },
+        { "\xe2\x82\xac", 1 },
+        { "\xf0\x9f\x98\x80", 1 },
+        { "\xf4\x8f\xbf\xbf", 1 },     /* U+10FFFF */
+        { "\x80", 0 },                  /* stray continuation */
+        { "\xc3", 0 },                  /* truncated */
+        { "\xc3\x28", 0 },
+        { "\xc0\xaf", 0 },              /* overlong */
+        { "\xe0\x80\xaf", 0 },          /* overlong */
+        { "\xf0\x80\x80\xaf", 0 },      /* overlong */
+        { "\xed\xa0\x80", 0 },          /* surrogate */
+        { "\xf4\x90\x80\x80", 0 },      /* above U+10FFFF */
+        { "\xf5\x80\x80\x80", 0 },
+        { "\xff", 0 },
+        { "\xe2\x82\xac\xe2\x82", 0 },
+    };
+    const enum scan_isa_t orig_isa = scan_get_isa();
+    char buf[600];
+    unsigned i, j, round;
+    (void)argc; (void)argv;
+
+    for (i = 0; i < ARRAY_SIZE(isas); ++i) {
+        if (scan_set_isa(isas[i]))
+            continue;  /* not supported by the CPU */
+
+        for (j = 0; j < ARRAY_SIZE(known); ++j) {
+            /* also embedded in long ASCII runs, to go through the vectorized
+             * paths */
+            const size_t len = strlen(known[j].str);
+            size_t pos;
+            ro_seg_t seg;
+            ro_seg_set_static(&seg, (char *)known[j].str);
+            ASSERT_EXP(utf8_is_valid(&seg) == known[j].valid);
+            for (pos = 0; pos < 100; pos += 7) {
+                memset(buf, 'x', 200);
+                memcpy(buf + pos, known[j].str, len);
+                ASSERT_EXP(utf8_chunked_is_valid(buf, 200, 200) == known[j].valid);
+                ASSERT_EXP(utf8_chunked_is_valid(buf, 200, 33) == known[j].valid);
+                ASSERT_EXP(utf8_chunked_is_valid(buf, 200, 1) == known[j].valid);
+            }
+        }
+
+        for (round = 0; round < 300; ++round) {
+            size_t size = 0, chunk_size;
+            int valid;
+            while (size < sizeof(buf) - 4)
+                size += utf8_append_random_char(buf + size);
+            /* corrupt some of the inputs */
+            if (round % 2)
+                buf[get_rand(size)] = (char)get_rand(256);
+
+            scan_set_isa(SCAN_ISA_PORTABLE);
+            valid = utf8_chunked_is_valid(buf, size, size);
+            scan_set_isa(isas[i]);
+            for (chunk_size = 1; chunk_size < 100; chunk_size += 13)
+                ASSERT_EXP(utf8_chunked_is_valid(buf, size, chunk_size) == valid);
+            ASSERT_EXP(utf8_chunked_is_valid(buf, size, size) == valid);
+        }
+    }
+
+    scan_set_isa(orig_isa);
+    return 0;
+}
+
 /* TEST json */
 
 static int seg_are_equal(seg_t *left, seg_t *right)
@@ -617,6 +2467,54 @@ static void test_json_unicode_sequences()
     test_json_higher_value_sequences();
 }
 
+/* returns the final code of parsing instr with UTF-8 validation enabled */
+static enum json_code_t json_string_parse_utf8(char * const instr,
+                                               const size_t max_bytes_per_parse)
+{
+    json_string_t jstr;
+    ro_seg_t inref, next_chunk;
+    enum json_code_t retval;
+
+    json_string_init(&jstr);
+    json_string_set_validate_utf8(&jstr, 1);
+    ro_seg_set_static(&inref, instr);
+
+    while (1) {
+        size_t orig_chunk_size;
+        ro_seg_assign(&next_chunk, &inref);
+        if (next_chunk.size > max_bytes_per_parse)
+            next_chunk.size = max_bytes_per_parse;
+        orig_chunk_size = next_chunk.size;
+
+        retval = json_string_parse(&jstr, &next_chunk);
+        ro_seg_trim_front(&inref, orig_chunk_size - next_chunk.size);
+        if (retval == JSON_INPUT_ERROR || next_chunk.size > 0)
+            break;
+        else if (inref.size == 0)
+            break;
+    }
+
+    json_string_uninit(&jstr);
+    return retval;
+}
+
+static void test_json_string_utf8()
+{
+    static const size_t bytes_per_parse[] = {100, 1, 2, 3};
+    unsigned i;
+
+    for (i = 0; i < ARRAY_SIZE(bytes_per_parse); ++i)
+    {
+        ASSERT_EXP(json_string_parse_utf8("caf\xc3\xa9\"", bytes_per_parse[i]) == JSON_READY);
+        ASSERT_EXP(json_string_parse_utf8("\xe2\x82\xac\\n\xc3\xa9", bytes_per_parse[i]) == JSON_READY);
+        ASSERT_EXP(json_string_parse_utf8("caf\xc3\x28", bytes_per_parse[i]) == JSON_INPUT_ERROR);
+        ASSERT_EXP(json_string_parse_utf8("\xed\xa0\x80", bytes_per_parse[i]) == JSON_INPUT_ERROR);
+        /* sequences cut short by the closing double-quote or an escape */
+        ASSERT_EXP(json_string_parse_utf8("caf\xc3\"", bytes_per_parse[i]) == JSON_INPUT_ERROR);
+        ASSERT_EXP(json_string_parse_utf8("caf\xc3\\n", bytes_per_parse[i]) == JSON_INPUT_ERROR);
+    }
+}
+
 static int test_json_string(int argc, char **argv)
 {
     static const size_t bytes_per_parse[] = {100, 1, 2, 3};
@@ -645,6 +2543,7 @@ static int test_json_string(int argc, char **argv)
     }
 
     test_json_unicode_sequences();
+    test_json_string_utf8();
 
     return 0;
 }
@@ -985,7 +2884,26 @@ static struct {
     const char *args_description;
 } argopts[] = {
     /* tests should take no cmdline arguments */
+    {"test_strarray", test_strarray, 0, ""},
+    {"test_vec", test_vec, 0, ""},
+    {"test_char_buffer", test_char_buffer, 0, ""},
+    {"test_rope", test_rope, 0, ""},
+    {"test_shared", test_shared, 0, ""},
+    {"test_scan", test_scan, 0, ""},
+    {"test_hash", test_hash, 0, ""},
+    {"test_intern", test_intern, 0, ""},
+    {"test_utf8", test_utf8, 0, ""},
+    {"test_arena", test_arena, 0, ""},
     {"test_line_reader", test_line_reader, 0, ""},
+    {"test_file_writer", test_file_writer, 0, ""},
+    {"test_log_writer", test_log_writer, 0, ""},
+    {"test_memory_reader", test_memory_reader, 0, ""},
+    {"test_mmap_reader", test_mmap_reader, 0, ""},
+    {"test_async_reader", test_async_reader, 0, ""},
+    {"test_prefetch_reader", test_prefetch_reader, 0, ""},
+    {"test_inflate_reader", test_inflate_reader, 0, ""},
+    {"test_lz4", test_lz4, 0, ""},
+    {"test_file_split", test_file_split, 0, ""},
     {"test_bintree", test_bintree, 0, ""},
     {"test_json_string", test_json_string, 0, ""},
     {"test_json_number", test_json_number, 0, ""},
@@ -994,6 +2912,7 @@ static struct {
     /* test utilities */
     {"line_reader_speed_baseline", line_reader_speed_baseline, 1, "<input file>" },
     {"line_reader_speed", line_reader_speed, 1, "<input file>" },
+    {"line_count_speed", line_count_speed, 1, "<input file>" },
 };
 static const unsigned argopts_size = ARRAY_SIZE(argopts);
 
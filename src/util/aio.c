@@ -0,0 +1,651 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "aio.h"
+#include "types.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#if defined(__linux__) && !defined(AIO_NO_URING)
+#   define AIO_URING
+#endif
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
+
+#ifdef AIO_URING
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <sched.h>
+#endif
+
+struct aio_slot_t
+{
+    char *buf;
+    uint64_t offset;
+    size_t size;    /* bytes requested */
+    size_t filled;  /* bytes read so far */
+    int active;     /* holds (part of) the file */
+    int inflight;   /* a read was issued and not reaped yet */
+    int completed;  /* the last read finished with result */
+    int result;     /* bytes read, or -1 with errnum set */
+    int errnum;
+#ifdef _WIN32
+    OVERLAPPED ov;
+    HANDLE event;  /* several reads share the file handle */
+#else
+    struct iovec iov;
+#endif
+};
+
+#ifdef AIO_URING
+
+struct aio_ring_t
+{
+    int fd;
+    unsigned *sq_tail;
+    unsigned *sq_mask;
+    unsigned *sq_array;
+    unsigned *cq_head;
+    unsigned *cq_tail;
+    unsigned *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_ptr;
+    void *cq_ptr;
+    size_t sq_len;
+    size_t cq_len;
+    size_t sqes_len;
+    unsigned to_submit;
+};
+
+#endif
+
+struct async_reader_t
+{
+    char *path;
+    int errnum;
+    const char *error;
+    size_t buflen;
+    size_t depth;
+    struct aio_slot_t *slots;
+    size_t cur;        /* slot to be returned next */
+    int cur_returned;  /* cur is held by the caller */
+    uint64_t file_size;
+    uint64_t next_offset;
+#ifdef _WIN32
+    HANDLE file;
+#else
+    int fd;
+#endif
+#ifdef AIO_URING
+    struct aio_ring_t ring;
+    int use_ring;
+#endif
+    uint64_t stalls;   /* reads which found their block still in flight */
+};
+
+/* could be overriden for unit test purposes, to exercise the synchronous
+ * fallback */
+int async_reader_force_sync = 0;
+/* could be overriden for unit test purposes: the next that many io_uring
+ * submissions fail */
+int async_reader_ring_failures = 0;
+
+static void aio_slot_fail(struct aio_slot_t *slot, int errnum)
+{
+    slot->completed = 1;
+    slot->result = -1;
+    slot->errnum = errnum;
+}
+
+#ifdef AIO_URING
+
+/* io_uring, driven through the raw system calls so that liburing is not
+ * required */
+
+static int aio_ring_init(struct aio_ring_t *ring, unsigned entries)
+{
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    memset(ring, 0, sizeof(*ring));
+
+    ring->fd = (int)syscall(__NR_io_uring_setup, entries, &p);
+    if (ring->fd < 0)
+        return -1;
+
+    ring->sq_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    ring->cq_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (ring->cq_len > ring->sq_len)
+            ring->sq_len = ring->cq_len;
+        ring->cq_len = ring->sq_len;
+    }
+    ring->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+
+    ring->sq_ptr = mmap(NULL, ring->sq_len, PROT_READ | PROT_WRITE,
+                        MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if (ring->sq_ptr == MAP_FAILED)
+        goto error;
+    if (p.features & IORING_FEAT_SINGLE_MMAP)
+        ring->cq_ptr = ring->sq_ptr;
+    else {
+        ring->cq_ptr = mmap(NULL, ring->cq_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if (ring->cq_ptr == MAP_FAILED)
+            goto error;
+    }
+    ring->sqes = (struct io_uring_sqe *)
+        mmap(NULL, ring->sqes_len, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if (ring->sqes == MAP_FAILED)
+        goto error;
+
+    ring->sq_tail = (unsigned *)((char *)ring->sq_ptr + p.sq_off.tail);
+    ring->sq_mask = (unsigned *)((char *)ring->sq_ptr + p.sq_off.ring_mask);
+    ring->sq_array = (unsigned *)((char *)ring->sq_ptr + p.sq_off.array);
+    ring->cq_head = (unsigned *)((char *)ring->cq_ptr + p.cq_off.head);
+    ring->cq_tail = (unsigned *)((char *)ring->cq_ptr + p.cq_off.tail);
+    ring->cq_mask = (unsigned *)((char *)ring->cq_ptr + p.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_ptr + p.cq_off.cqes);
+    return 0;
+
+error:
+    {
+        const int errnum = errno;
+        if (ring->sq_ptr != NULL && ring->sq_ptr != MAP_FAILED)
+            munmap(ring->sq_ptr, ring->sq_len);
+        if (ring->cq_ptr != NULL && ring->cq_ptr != MAP_FAILED &&
+                ring->cq_ptr != ring->sq_ptr)
+            munmap(ring->cq_ptr, ring->cq_len);
+        close(ring->fd);
+        errno = errnum;
+    }
+    return -1;
+}
+
+static void aio_ring_uninit(struct aio_ring_t *ring)
+{
+    munmap(ring->sqes, ring->sqes_len);
+    if (ring->cq_ptr != ring->sq_ptr)
+        munmap(ring->cq_ptr, ring->cq_len);
+    munmap(ring->sq_ptr, ring->sq_len);
+    close(ring->fd);
+}
+
+/* submits queued entries and, if min_complete > 0, waits for completions */
+static int aio_ring_enter(struct aio_ring_t *ring, unsigned min_complete)
+{
+    while (ring->to_submit > 0 || min_complete > 0) {
+        const int ret = (int)syscall(__NR_io_uring_enter, ring->fd,
+                                     ring->to_submit, min_complete,
+                                     min_complete > 0 ? IORING_ENTER_GETEVENTS : 0,
+                                     NULL, 0);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            return -1;
+        }
+        ring->to_submit -= (unsigned)ret;
+        if (min_complete > 0)
+            break;
+    }
+    return 0;
+}
+
+static void aio_ring_queue_read(struct aio_ring_t *ring,
+                                int fd,
+                                struct aio_slot_t *slot,
+                                size_t slot_index)
+{
+    const unsigned tail = *ring->sq_tail;
+    const unsigned idx = tail & *ring->sq_mask;
+    struct io_uring_sqe *sqe = &ring->sqes[idx];
+
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = IORING_OP_READV;
+    sqe->fd = fd;
+    sqe->addr = (uint64_t)(uintptr_t)&slot->iov;
+    sqe->len = 1;
+    sqe->off = slot->offset + slot->filled;
+    sqe->user_data = slot_index;
+    ring->sq_array[idx] = idx;
+    __atomic_store_n(ring->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    ++ring->to_submit;
+}
+
+static void aio_ring_reap(struct async_reader_t *ar)
+{
+    struct aio_ring_t *ring = &ar->ring;
+    unsigned head = *ring->cq_head;
+
+    while (head != __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE)) {
+        const struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+        struct aio_slot_t *slot = &ar->slots[cqe->user_data];
+        slot->inflight = 0;
+        if (cqe->res < 0)
+            aio_slot_fail(slot, -cqe->res);
+        else {
+            slot->completed = 1;
+            slot->result = cqe->res;
+        }
+        ++head;
+    }
+    __atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+}
+
+/* aio_ring_enter() for the reader, with the failures injected by the unit
+ * tests */
+static int async_reader_ring_enter(struct async_reader_t *ar,
+                                   unsigned min_complete)
+{
+    if (async_reader_ring_failures > 0) {
+        --async_reader_ring_failures;
+        errno = EBUSY;
+        return -1;
+    }
+    return aio_ring_enter(&ar->ring, min_complete);
+}
+
+/* Gives up on the ring: entries the kernel has not picked up yet are
+ * withdrawn, and the reads it has are waited for, since they still write into
+ * the buffers.  Whatever is left incomplete is then read with pread. */
+static void aio_ring_drop(struct async_reader_t *ar)
+{
+    struct aio_ring_t *ring = &ar->ring;
+    const unsigned tail = *ring->sq_tail;
+    unsigned i;
+    size_t j;
+
+    for (i = 0; i < ring->to_submit; ++i) {
+        const unsigned idx = (tail - 1 - i) & *ring->sq_mask;
+        ar->slots[ring->sqes[idx].user_data].inflight = 0;
+    }
+    __atomic_store_n(ring->sq_tail, tail - ring->to_submit, __ATOMIC_RELEASE);
+    ring->to_submit = 0;
+
+    for (j = 0; j < ar->depth; ++j) {
+        while (ar->slots[j].inflight) {
+            if (async_reader_ring_enter(ar, 1) < 0)
+                sched_yield();  /* the completion arrives all the same */
+            aio_ring_reap(ar);
+        }
+    }
+    aio_ring_uninit(ring);
+    ar->use_ring = 0;
+}
+
+/* submits the queued reads without waiting for any */
+static void async_reader_submit(struct async_reader_t *ar)
+{
+    if (ar->use_ring && async_reader_ring_enter(ar, 0) < 0)
+        aio_ring_drop(ar);
+}
+
+#endif  /* AIO_URING */
+
+#ifdef _WIN32
+
+static int async_reader_open_file(struct async_reader_t *ar)
+{
+    LARGE_INTEGER size;
+    ar->file = CreateFileA(ar->path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING,
+                           FILE_FLAG_OVERLAPPED | FILE_FLAG_SEQUENTIAL_SCAN,
+                           NULL);
+    if (ar->file == INVALID_HANDLE_VALUE) {
+        ar->error = "CreateFile failed";
+        goto error;
+    }
+    if (!GetFileSizeEx(ar->file, &size)) {
+        ar->error = "GetFileSizeEx failed";
+        goto error;
+    }
+    ar->file_size = (uint64_t)size.QuadPart;
+    return 0;
+
+error:
+    ar->errnum = (int)GetLastError();
+    return -1;
+}
+
+static void async_reader_issue(struct async_reader_t *ar, size_t slot_index)
+{
+    struct aio_slot_t *slot = &ar->slots[slot_index];
+    const uint64_t offset = slot->offset + slot->filled;
+
+    slot->completed = 0;
+    memset(&slot->ov, 0, sizeof(slot->ov));
+    slot->ov.Offset = (DWORD)(offset & 0xffffffff);
+    slot->ov.OffsetHigh = (DWORD)(offset >> 32);
+    slot->ov.hEvent = slot->event;
+    if (async_reader_force_sync)
+        return;  /* read in async_reader_wait() */
+
+    if (!ReadFile(ar->file, slot->buf + slot->filled,
+                  (DWORD)(slot->size - slot->filled), NULL, &slot->ov) &&
+            GetLastError() != ERROR_IO_PENDING) {
+        aio_slot_fail(slot, (int)GetLastError());
+        return;
+    }
+    slot->inflight = 1;
+}
+
+static void async_reader_wait(struct async_reader_t *ar, size_t slot_index)
+{
+    struct aio_slot_t *slot = &ar->slots[slot_index];
+    DWORD bytes;
+
+    if (slot->completed)
+        return;
+    if (slot->inflight && !HasOverlappedIoCompleted(&slot->ov))
+        ++ar->stalls;
+    if (!slot->inflight) {
+        /* synchronous fallback */
+        if (!ReadFile(ar->file, slot->buf + slot->filled,
+                      (DWORD)(slot->size - slot->filled), NULL, &slot->ov) &&
+                GetLastError() != ERROR_IO_PENDING &&
+                GetLastError() != ERROR_HANDLE_EOF) {
+            aio_slot_fail(slot, (int)GetLastError());
+            return;
+        }
+    }
+
+    slot->inflight = 0;
+    if (!GetOverlappedResult(ar->file, &slot->ov, &bytes, TRUE)) {
+        if (GetLastError() != ERROR_HANDLE_EOF) {
+            aio_slot_fail(slot, (int)GetLastError());
+            return;
+        }
+        bytes = 0;
+    }
+    slot->completed = 1;
+    slot->result = (int)bytes;
+}
+
+static void async_reader_close_file(struct async_reader_t *ar)
+{
+    size_t i;
+    if (ar->file == INVALID_HANDLE_VALUE)
+        return;
+
+    /* the buffers must not be freed while the kernel can still write to
+     * them */
+    CancelIo(ar->file);
+    for (i = 0; i < ar->depth; ++i) {
+        DWORD bytes;
+        if (ar->slots[i].inflight)
+            GetOverlappedResult(ar->file, &ar->slots[i].ov, &bytes, TRUE);
+    }
+    CloseHandle(ar->file);
+}
+
+#else  /* POSIX */
+
+static int async_reader_open_file(struct async_reader_t *ar)
+{
+    struct stat st;
+
+    ar->fd = open(ar->path, O_RDONLY);
+    if (ar->fd < 0) {
+        ar->error = "open failed";
+        goto error;
+    }
+    if (fstat(ar->fd, &st) < 0) {
+        ar->error = "fstat failed";
+        goto error;
+    }
+    ar->file_size = (uint64_t)st.st_size;
+
+#ifdef AIO_URING
+    ar->use_ring = !async_reader_force_sync &&
+                   aio_ring_init(&ar->ring, (unsigned)ar->depth) == 0;
+#endif
+    return 0;
+
+error:
+    ar->errnum = errno;
+    return -1;
+}
+
+static void async_reader_issue(struct async_reader_t *ar, size_t slot_index)
+{
+    struct aio_slot_t *slot = &ar->slots[slot_index];
+
+    slot->completed = 0;
+    slot->iov.iov_base = slot->buf + slot->filled;
+    slot->iov.iov_len = slot->size - slot->filled;
+#ifdef AIO_URING
+    if (ar->use_ring) {
+        aio_ring_queue_read(&ar->ring, ar->fd, slot, slot_index);
+        slot->inflight = 1;
+    }
+#else
+    (void)ar;
+#endif
+}
+
+static void async_reader_wait(struct async_reader_t *ar, size_t slot_index)
+{
+    struct aio_slot_t *slot = &ar->slots[slot_index];
+
+#ifdef AIO_URING
+    if (slot->inflight) {
+        aio_ring_reap(ar);
+        if (slot->inflight)
+            ++ar->stalls;
+    }
+    while (slot->inflight) {
+        if (async_reader_ring_enter(ar, 1) < 0) {
+            /* the ring is unusable; fall back to synchronous reads */
+            aio_ring_drop(ar);
+            break;
+        }
+        aio_ring_reap(ar);
+    }
+#endif
+
+    if (!slot->completed) {
+        ssize_t ret;
+        do {
+            ret = pread(ar->fd, slot->iov.iov_base, slot->iov.iov_len,
+                        (off_t)(slot->offset + slot->filled));
+        } while (ret < 0 && errno == EINTR);
+        if (ret < 0)
+            aio_slot_fail(slot, errno);
+        else {
+            slot->completed = 1;
+            slot->result = (int)ret;
+        }
+    }
+}
+
+static void async_reader_close_file(struct async_reader_t *ar)
+{
+    if (ar->fd < 0)
+        return;
+
+#ifdef AIO_URING
+    /* the buffers must not be freed while the kernel can still write to
+     * them */
+    if (ar->use_ring)
+        aio_ring_drop(ar);
+#endif
+    close(ar->fd);
+}
+
+#endif  /* _WIN32 */
+
+/* gives the slot the next block of the file, if there is one left */
+static void async_reader_queue(struct async_reader_t *ar, size_t slot_index)
+{
+    struct aio_slot_t *slot = &ar->slots[slot_index];
+    uint64_t remaining;
+
+    slot->active = 0;
+    if (ar->next_offset >= ar->file_size)
+        return;
+
+    remaining = ar->file_size - ar->next_offset;
+    slot->offset = ar->next_offset;
+    slot->size = (uint64_t)ar->buflen < remaining ? ar->buflen : (size_t)remaining;
+    slot->filled = 0;
+    slot->active = 1;
+    ar->next_offset += slot->size;
+    async_reader_issue(ar, slot_index);
+}
+
+static int async_reader_open(void *data)
+{
+    struct async_reader_t *ar = (struct async_reader_t *)data;
+    size_t i;
+
+    if (async_reader_open_file(ar) < 0)
+        return -1;
+
+    for (i = 0; i < ar->depth; ++i)
+        async_reader_queue(ar, i);
+#ifdef AIO_URING
+    async_reader_submit(ar);
+#endif
+    return 0;
+}
+
+static int async_reader_read(void *data, ro_seg_t *seg)
+{
+    struct async_reader_t *ar = (struct async_reader_t *)data;
+    struct aio_slot_t *slot;
+
+    if (ar->cur_returned) {
+        /* the caller is done with the previous block */
+        async_reader_queue(ar, ar->cur);
+#ifdef AIO_URING
+        async_reader_submit(ar);
+#endif
+        ar->cur = (ar->cur + 1) % ar->depth;
+        ar->cur_returned = 0;
+    }
+
+    slot = &ar->slots[ar->cur];
+    if (!slot->active)
+        return 0;
+
+    /* a short read is continued until the block is full or EOF is hit */
+    while (1) {
+        async_reader_wait(ar, ar->cur);
+        if (slot->result < 0) {
+            ar->errnum = slot->errnum;
+            ar->error = "read failed";
+            return -1;
+        }
+        slot->filled += (size_t)slot->result;
+        if (slot->result == 0 || slot->filled == slot->size)
+            break;
+        async_reader_issue(ar, ar->cur);
+#ifdef AIO_URING
+        async_reader_submit(ar);
+#endif
+    }
+
+    if (slot->filled == 0)
+        return 0;
+
+    ar->cur_returned = 1;
+    seg->start = slot->buf;
+    seg->size = slot->filled;
+    return (int)slot->filled;
+}
+
+static void async_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    struct async_reader_t *ar = (struct async_reader_t *)data;
+    *buf = ar->error;
+    *errnum = ar->errnum;
+}
+
+void po_async_reader_init(struct strrdr_t *reader,
+                          const char *path,
+                          size_t buflen,
+                          size_t depth)
+{
+    struct async_reader_t *ar = (struct async_reader_t *)malloc(sizeof(struct async_reader_t));
+    size_t i;
+
+    assert(reader != NULL);
+    assert(buflen > 0 && buflen <= INT_MAX);
+    assert(depth > 0);
+    ar->path = dup_str(path);
+    ar->errnum = 0;
+    ar->error = "";
+    ar->buflen = buflen;
+    ar->depth = depth;
+    ar->slots = (struct aio_slot_t *)calloc(depth, sizeof(struct aio_slot_t));
+    for (i = 0; i < depth; ++i) {
+        ar->slots[i].buf = (char *)malloc(buflen);
+#ifdef _WIN32
+        ar->slots[i].event = CreateEvent(NULL, TRUE, FALSE, NULL);
+#endif
+    }
+    ar->cur = 0;
+    ar->cur_returned = 0;
+    ar->file_size = 0;
+    ar->next_offset = 0;
+#ifdef _WIN32
+    ar->file = INVALID_HANDLE_VALUE;
+#else
+    ar->fd = -1;
+#endif
+#ifdef AIO_URING
+    ar->use_ring = 0;
+#endif
+    ar->stalls = 0;
+    reader->data = ar;
+    reader->open = async_reader_open;
+    reader->read = async_reader_read;
+    reader->get_error = async_reader_get_error;
+}
+
+uint64_t async_reader_get_stalls(struct strrdr_t *reader)
+{
+    return ((struct async_reader_t *)reader->data)->stalls;
+}
+
+void po_async_reader_uninit(struct strrdr_t *reader)
+{
+    struct async_reader_t *ar = (struct async_reader_t *)reader->data;
+    size_t i;
+
+    async_reader_close_file(ar);
+    for (i = 0; i < ar->depth; ++i) {
+        free(ar->slots[i].buf);
+#ifdef _WIN32
+        CloseHandle(ar->slots[i].event);
+#endif
+    }
+    free(ar->slots);
+    free(ar->path);
+    free(ar);
+}
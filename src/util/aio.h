@@ -0,0 +1,44 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef AIO_H
+#define AIO_H
+
+#include "io.h"
+
+/* Asynchronous file reader: keeps up to depth reads of buflen bytes in
+ * flight, in a ring of buffers, and hands them out in file order, so that
+ * I/O overlaps with processing of the previous block.  A segment stays valid
+ * until the next read, after which its buffer is queued again.
+ *
+ * Reads are issued through io_uring on Linux and overlapped ReadFile on
+ * Win32.  Elsewhere, or when io_uring is unavailable at runtime (old kernel,
+ * seccomp), the reader falls back to synchronous reads. */
+
+#define ASYNC_READER_BUFLEN (1024 * 1024)
+#define ASYNC_READER_DEPTH 4
+
+void po_async_reader_init(struct strrdr_t *reader,
+                          const char *path,
+                          size_t buflen,
+                          size_t depth);
+void po_async_reader_uninit(struct strrdr_t *reader);
+
+/* number of reads which had to wait for their block, which was still in
+ * flight; a consumer slower than the reads should see next to none */
+uint64_t async_reader_get_stalls(struct strrdr_t *reader);
+
+#endif  /* AIO_H */
@@ -0,0 +1,196 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "alloc.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+void *allocator_alloc(struct allocator_t *allocator, size_t size)
+{
+    if (allocator == NULL)
+        return malloc(size);
+    return allocator->alloc(allocator->data, size);
+}
+
+void *allocator_realloc(struct allocator_t *allocator,
+                        void *ptr,
+                        size_t old_size,
+                        size_t new_size)
+{
+    if (allocator == NULL)
+        return realloc(ptr, new_size);
+    return allocator->realloc(allocator->data, ptr, old_size, new_size);
+}
+
+void allocator_free(struct allocator_t *allocator, void *ptr, size_t size)
+{
+    if (allocator == NULL)
+        free(ptr);
+    else if (ptr != NULL)
+        allocator->free(allocator->data, ptr, size);
+}
+
+/* arena_t */
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_ALIGN(sz) (((sz) + (ARENA_ALIGNMENT - 1)) & ~(size_t)(ARENA_ALIGNMENT - 1))
+
+struct arena_block_t
+{
+    struct arena_block_t *next;
+    size_t size;
+};
+
+/* the usable memory follows the block header */
+#define ARENA_BLOCK_HEADER_SIZE ARENA_ALIGN(sizeof(struct arena_block_t))
+#define ARENA_BLOCK_START(block) ((char *)(block) + ARENA_BLOCK_HEADER_SIZE)
+
+static void *arena_allocator_alloc(void *data, size_t size)
+{
+    return arena_alloc((struct arena_t *)data, size);
+}
+
+static void *arena_allocator_realloc(void *data,
+                                     void *ptr,
+                                     size_t old_size,
+                                     size_t new_size)
+{
+    return arena_realloc((struct arena_t *)data, ptr, old_size, new_size);
+}
+
+static void arena_allocator_free(void *data, void *ptr, size_t size)
+{
+    arena_free((struct arena_t *)data, ptr, size);
+}
+
+void arena_init(struct arena_t *arena, size_t block_size)
+{
+    assert(block_size > 0);
+    arena->head = arena->cur = NULL;
+    arena->ptr = arena->end = NULL;
+    arena->block_size = ARENA_ALIGN(block_size);
+    arena->allocator.alloc = arena_allocator_alloc;
+    arena->allocator.realloc = arena_allocator_realloc;
+    arena->allocator.free = arena_allocator_free;
+    arena->allocator.data = arena;
+}
+
+void arena_uninit(struct arena_t *arena)
+{
+    struct arena_block_t *block = arena->head;
+    while (block != NULL) {
+        struct arena_block_t *next = block->next;
+        free(block);
+        block = next;
+    }
+    arena->head = arena->cur = NULL;
+    arena->ptr = arena->end = NULL;
+}
+
+static void arena_use_block(struct arena_t *arena, struct arena_block_t *block)
+{
+    arena->cur = block;
+    arena->ptr = ARENA_BLOCK_START(block);
+    arena->end = arena->ptr + block->size;
+}
+
+/* moves on to a block with at least size bytes available; reuses the blocks
+ * left over from before arena_reset() when they are large enough */
+static int arena_next_block(struct arena_t *arena, size_t size)
+{
+    struct arena_block_t *block;
+    struct arena_block_t *next =
+        arena->cur != NULL ? arena->cur->next : arena->head;
+
+    if (next != NULL && next->size >= size) {
+        arena_use_block(arena, next);
+        return 0;
+    }
+
+    if (size < arena->block_size)
+        size = arena->block_size;
+    block = (struct arena_block_t *)malloc(ARENA_BLOCK_HEADER_SIZE + size);
+    if (block == NULL)
+        return -1;
+    block->size = size;
+    block->next = next;
+    if (arena->cur != NULL)
+        arena->cur->next = block;
+    else
+        arena->head = block;
+    arena_use_block(arena, block);
+    return 0;
+}
+
+void *arena_alloc(struct arena_t *arena, size_t size)
+{
+    char *ptr;
+    size = ARENA_ALIGN(size);
+    if ((size_t)(arena->end - arena->ptr) < size) {
+        if (arena_next_block(arena, size))
+            return NULL;
+    }
+    ptr = arena->ptr;
+    arena->ptr += size;
+    return ptr;
+}
+
+void *arena_realloc(struct arena_t *arena,
+                    void *ptr,
+                    size_t old_size,
+                    size_t new_size)
+{
+    char *newptr;
+
+    if (ptr == NULL)
+        return arena_alloc(arena, new_size);
+
+    if ((char *)ptr + ARENA_ALIGN(old_size) == arena->ptr &&
+        (size_t)(arena->end - (char *)ptr) >= ARENA_ALIGN(new_size))
+    {
+        /* the most recent allocation: resize it in place */
+        arena->ptr = (char *)ptr + ARENA_ALIGN(new_size);
+        return ptr;
+    }
+
+    /* shrinking anything else leaves the tail unused rather than copying */
+    if (ARENA_ALIGN(new_size) <= ARENA_ALIGN(old_size))
+        return ptr;
+
+    newptr = (char *)arena_alloc(arena, new_size);
+    if (newptr != NULL)
+        memcpy(newptr, ptr, old_size < new_size ? old_size : new_size);
+    return newptr;
+}
+
+void arena_free(struct arena_t *arena, void *ptr, size_t size)
+{
+    /* only the most recent allocation can be given back */
+    if ((char *)ptr + ARENA_ALIGN(size) == arena->ptr)
+        arena->ptr = (char *)ptr;
+}
+
+void arena_reset(struct arena_t *arena)
+{
+    if (arena->head != NULL)
+        arena_use_block(arena, arena->head);
+}
+
+struct allocator_t *arena_allocator(struct arena_t *arena)
+{
+    return &arena->allocator;
+}
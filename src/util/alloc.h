@@ -0,0 +1,74 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ALLOC_H
+#define ALLOC_H
+
+#include <stddef.h>
+
+/* allocator_t: memory source for str_t and the containers built on top of
+ * it.  A NULL allocator_t pointer everywhere means plain malloc()/free(). */
+
+struct allocator_t
+{
+    void *(* alloc)(void *, size_t);
+    /* arguments: data, ptr, old size, new size */
+    void *(* realloc)(void *, void *, size_t, size_t);
+    /* the size is the one requested from alloc() */
+    void (* free)(void *, void *, size_t);
+    void *data;
+};
+
+void *allocator_alloc(struct allocator_t *allocator, size_t size);
+void *allocator_realloc(struct allocator_t *allocator,
+                        void *ptr,
+                        size_t old_size,
+                        size_t new_size);
+void allocator_free(struct allocator_t *allocator, void *ptr, size_t size);
+
+
+/* arena_t: bump-pointer allocator.  Individual frees are no-ops (except for
+ * the most recent allocation, which is given back), and all of the memory is
+ * released at once with arena_reset() or arena_uninit().  Not thread-safe:
+ * use one arena per thread. */
+
+struct arena_block_t;
+
+struct arena_t
+{
+    struct arena_block_t *head;
+    struct arena_block_t *cur;
+    char *ptr;
+    char *end;
+    size_t block_size;
+    struct allocator_t allocator;
+};
+
+void arena_init(struct arena_t *arena, size_t block_size);
+void arena_uninit(struct arena_t *arena);
+void *arena_alloc(struct arena_t *arena, size_t size);
+/* grows or shrinks in place when ptr is the most recent allocation */
+void *arena_realloc(struct arena_t *arena,
+                    void *ptr,
+                    size_t old_size,
+                    size_t new_size);
+void arena_free(struct arena_t *arena, void *ptr, size_t size);
+/* makes all of the memory handed out so far available again; the blocks are
+ * kept for reuse, so this does not depend on the number of allocations */
+void arena_reset(struct arena_t *arena);
+struct allocator_t *arena_allocator(struct arena_t *arena);
+
+#endif  /* ALLOC_H */
@@ -0,0 +1,349 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "hash.h"
+#include <string.h>
+#include <assert.h>
+
+#define PRIME64_1 0x9E3779B185EBCA87ULL
+#define PRIME64_2 0xC2B2AE3D27D4EB4FULL
+#define PRIME64_3 0x165667B19E3779F9ULL
+#define PRIME64_4 0x85EBCA77C2B2AE63ULL
+#define PRIME64_5 0x27D4EB2F165667C5ULL
+
+#define ROTL64(x, r) (((x) << (r)) | ((x) >> (64 - (r))))
+
+#define STRIPE_SIZE 32
+
+/* unaligned loads; assumes a little-endian host */
+static uint64_t read64(const unsigned char *p)
+{
+    uint64_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t read32(const unsigned char *p)
+{
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint64_t round64(uint64_t acc, uint64_t input)
+{
+    acc += input * PRIME64_2;
+    acc = ROTL64(acc, 31);
+    return acc * PRIME64_1;
+}
+
+static uint64_t merge_round64(uint64_t hash, uint64_t acc)
+{
+    hash ^= round64(0, acc);
+    return hash * PRIME64_1 + PRIME64_4;
+}
+
+static void init_acc(uint64_t *acc, uint64_t seed)
+{
+    acc[0] = seed + PRIME64_1 + PRIME64_2;
+    acc[1] = seed + PRIME64_2;
+    acc[2] = seed;
+    acc[3] = seed - PRIME64_1;
+}
+
+/* consumes as many whole stripes as there are in p..p+size, and returns the
+ * number of bytes consumed */
+static size_t consume_stripes(uint64_t *acc, const unsigned char *p, size_t size)
+{
+    const unsigned char * const start = p;
+    const unsigned char * const limit = p + (size - size % STRIPE_SIZE);
+    uint64_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+
+    while (p < limit) {
+        a0 = round64(a0, read64(p));
+        a1 = round64(a1, read64(p + 8));
+        a2 = round64(a2, read64(p + 16));
+        a3 = round64(a3, read64(p + 24));
+        p += STRIPE_SIZE;
+    }
+
+    acc[0] = a0; acc[1] = a1; acc[2] = a2; acc[3] = a3;
+    return (size_t)(p - start);
+}
+
+/* mixes in the remaining (less than STRIPE_SIZE) bytes and avalanches */
+static uint64_t finalize(uint64_t hash, const unsigned char *p, size_t size)
+{
+    assert(size < STRIPE_SIZE);
+
+    while (size >= 8) {
+        hash ^= round64(0, read64(p));
+        hash = ROTL64(hash, 27) * PRIME64_1 + PRIME64_4;
+        p += 8;
+        size -= 8;
+    }
+    if (size >= 4) {
+        hash ^= (uint64_t)read32(p) * PRIME64_1;
+        hash = ROTL64(hash, 23) * PRIME64_2 + PRIME64_3;
+        p += 4;
+        size -= 4;
+    }
+    while (size > 0) {
+        hash ^= (*p) * PRIME64_5;
+        hash = ROTL64(hash, 11) * PRIME64_1;
+        ++p;
+        --size;
+    }
+
+    hash ^= hash >> 33;
+    hash *= PRIME64_2;
+    hash ^= hash >> 29;
+    hash *= PRIME64_3;
+    hash ^= hash >> 32;
+    return hash;
+}
+
+static uint64_t converge(const uint64_t *acc)
+{
+    uint64_t hash = ROTL64(acc[0], 1) + ROTL64(acc[1], 7) +
+                    ROTL64(acc[2], 12) + ROTL64(acc[3], 18);
+    hash = merge_round64(hash, acc[0]);
+    hash = merge_round64(hash, acc[1]);
+    hash = merge_round64(hash, acc[2]);
+    hash = merge_round64(hash, acc[3]);
+    return hash;
+}
+
+uint64_t hash64(const void *buf, size_t size, uint64_t seed)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    uint64_t hash;
+
+    if (size >= STRIPE_SIZE) {
+        uint64_t acc[4];
+        size_t consumed;
+        init_acc(acc, seed);
+        consumed = consume_stripes(acc, p, size);
+        hash = converge(acc);
+        p += consumed;
+        hash += (uint64_t)size;
+        return finalize(hash, p, size - consumed);
+    }
+
+    hash = seed + PRIME64_5 + (uint64_t)size;
+    return finalize(hash, p, size);
+}
+
+uint64_t ro_seg_hash(const ro_seg_t *seg, uint64_t seed)
+{
+    return hash64(seg->start, seg->size, seed);
+}
+
+void hash_state_init(struct hash_state_t *state, uint64_t seed)
+{
+    init_acc(state->acc, seed);
+    state->seed = seed;
+    state->total_size = 0;
+    state->buf_size = 0;
+}
+
+void hash_state_update(struct hash_state_t *state, const ro_seg_t *seg)
+{
+    const unsigned char *p = (const unsigned char *)seg->start;
+    size_t size = seg->size;
+
+    state->total_size += size;
+
+    if (state->buf_size > 0) {
+        /* complete the stripe left over from the previous update first */
+        size_t len = STRIPE_SIZE - state->buf_size;
+        if (len > size)
+            len = size;
+        memcpy(state->buf + state->buf_size, p, len);
+        state->buf_size += len;
+        p += len;
+        size -= len;
+        if (state->buf_size < STRIPE_SIZE)
+            return;
+        consume_stripes(state->acc, state->buf, STRIPE_SIZE);
+        state->buf_size = 0;
+    }
+
+    {
+        const size_t consumed = consume_stripes(state->acc, p, size);
+        p += consumed;
+        size -= consumed;
+    }
+
+    memcpy(state->buf, p, size);
+    state->buf_size = size;
+}
+
+uint64_t hash_state_final(const struct hash_state_t *state)
+{
+    uint64_t hash;
+    if (state->total_size >= STRIPE_SIZE)
+        hash = converge(state->acc);
+    else
+        hash = state->seed + PRIME64_5;
+    hash += state->total_size;
+    return finalize(hash, state->buf, state->buf_size);
+}
+
+/* XXH32 */
+
+#define PRIME32_1 0x9E3779B1U
+#define PRIME32_2 0x85EBCA77U
+#define PRIME32_3 0xC2B2AE3DU
+#define PRIME32_4 0x27D4EB2FU
+#define PRIME32_5 0x165667B1U
+
+#define ROTL32(x, r) (((x) << (r)) | ((x) >> (32 - (r))))
+
+#define STRIPE32_SIZE 16
+
+static uint32_t round32(uint32_t acc, uint32_t input)
+{
+    acc += input * PRIME32_2;
+    acc = ROTL32(acc, 13);
+    return acc * PRIME32_1;
+}
+
+static void init_acc32(uint32_t *acc, uint32_t seed)
+{
+    acc[0] = seed + PRIME32_1 + PRIME32_2;
+    acc[1] = seed + PRIME32_2;
+    acc[2] = seed;
+    acc[3] = seed - PRIME32_1;
+}
+
+static size_t consume_stripes32(uint32_t *acc, const unsigned char *p, size_t size)
+{
+    const unsigned char * const start = p;
+    const unsigned char * const limit = p + (size - size % STRIPE32_SIZE);
+    uint32_t a0 = acc[0], a1 = acc[1], a2 = acc[2], a3 = acc[3];
+
+    while (p < limit) {
+        a0 = round32(a0, read32(p));
+        a1 = round32(a1, read32(p + 4));
+        a2 = round32(a2, read32(p + 8));
+        a3 = round32(a3, read32(p + 12));
+        p += STRIPE32_SIZE;
+    }
+
+    acc[0] = a0; acc[1] = a1; acc[2] = a2; acc[3] = a3;
+    return (size_t)(p - start);
+}
+
+static uint32_t finalize32(uint32_t hash, const unsigned char *p, size_t size)
+{
+    assert(size < STRIPE32_SIZE);
+
+    while (size >= 4) {
+        hash += read32(p) * PRIME32_3;
+        hash = ROTL32(hash, 17) * PRIME32_4;
+        p += 4;
+        size -= 4;
+    }
+    while (size > 0) {
+        hash += (*p) * PRIME32_5;
+        hash = ROTL32(hash, 11) * PRIME32_1;
+        ++p;
+        --size;
+    }
+
+    hash ^= hash >> 15;
+    hash *= PRIME32_2;
+    hash ^= hash >> 13;
+    hash *= PRIME32_3;
+    hash ^= hash >> 16;
+    return hash;
+}
+
+static uint32_t converge32(const uint32_t *acc)
+{
+    return ROTL32(acc[0], 1) + ROTL32(acc[1], 7) +
+           ROTL32(acc[2], 12) + ROTL32(acc[3], 18);
+}
+
+uint32_t hash32(const void *buf, size_t size, uint32_t seed)
+{
+    const unsigned char *p = (const unsigned char *)buf;
+    uint32_t hash;
+
+    if (size >= STRIPE32_SIZE) {
+        uint32_t acc[4];
+        size_t consumed;
+        init_acc32(acc, seed);
+        consumed = consume_stripes32(acc, p, size);
+        hash = converge32(acc) + (uint32_t)size;
+        return finalize32(hash, p + consumed, size - consumed);
+    }
+
+    hash = seed + PRIME32_5 + (uint32_t)size;
+    return finalize32(hash, p, size);
+}
+
+void hash32_state_init(struct hash32_state_t *state, uint32_t seed)
+{
+    init_acc32(state->acc, seed);
+    state->seed = seed;
+    state->total_size = 0;
+    state->buf_size = 0;
+}
+
+void hash32_state_update(struct hash32_state_t *state, const ro_seg_t *seg)
+{
+    const unsigned char *p = (const unsigned char *)seg->start;
+    size_t size = seg->size;
+
+    state->total_size += size;
+
+    if (state->buf_size > 0) {
+        size_t len = STRIPE32_SIZE - state->buf_size;
+        if (len > size)
+            len = size;
+        memcpy(state->buf + state->buf_size, p, len);
+        state->buf_size += len;
+        p += len;
+        size -= len;
+        if (state->buf_size < STRIPE32_SIZE)
+            return;
+        consume_stripes32(state->acc, state->buf, STRIPE32_SIZE);
+        state->buf_size = 0;
+    }
+
+    {
+        const size_t consumed = consume_stripes32(state->acc, p, size);
+        p += consumed;
+        size -= consumed;
+    }
+
+    memcpy(state->buf, p, size);
+    state->buf_size = size;
+}
+
+uint32_t hash32_state_final(const struct hash32_state_t *state)
+{
+    uint32_t hash;
+    if (state->total_size >= STRIPE32_SIZE)
+        hash = converge32(state->acc);
+    else
+        hash = state->seed + PRIME32_5;
+    /* XXH32 mixes in the total size modulo 2^32 */
+    hash += (uint32_t)state->total_size;
+    return finalize32(hash, state->buf, state->buf_size);
+}
@@ -0,0 +1,63 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef HASH_H
+#define HASH_H
+
+#include "str.h"
+#include "types.h"
+
+/* Fast non-cryptographic 64-bit hashing (XXH64: the input is consumed 32
+ * bytes per round, as four independent 8-byte lanes).  Produces the same
+ * values as the reference XXH64 on little-endian hosts. */
+
+uint64_t hash64(const void *buf, size_t size, uint64_t seed);
+uint64_t ro_seg_hash(const ro_seg_t *seg, uint64_t seed);
+
+/* incremental hashing of data that arrives in chunks (e.g. from
+ * strrdr_read()); the result is the same as hashing all of it at once */
+
+struct hash_state_t
+{
+    uint64_t acc[4];
+    uint64_t seed;
+    uint64_t total_size;
+    unsigned char buf[32];  /* incomplete stripe */
+    size_t buf_size;
+};
+
+void hash_state_init(struct hash_state_t *state, uint64_t seed);
+void hash_state_update(struct hash_state_t *state, const ro_seg_t *seg);
+uint64_t hash_state_final(const struct hash_state_t *state);
+
+/* XXH32, the 32-bit variant, as used by e.g. the LZ4 frame format */
+
+uint32_t hash32(const void *buf, size_t size, uint32_t seed);
+
+struct hash32_state_t
+{
+    uint32_t acc[4];
+    uint32_t seed;
+    uint64_t total_size;
+    unsigned char buf[16];  /* incomplete stripe */
+    size_t buf_size;
+};
+
+void hash32_state_init(struct hash32_state_t *state, uint32_t seed);
+void hash32_state_update(struct hash32_state_t *state, const ro_seg_t *seg);
+uint32_t hash32_state_final(const struct hash32_state_t *state);
+
+#endif  /* HASH_H */
@@ -0,0 +1,753 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "inflate.h"
+#include "types.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#define INFLATE_WINDOW 32768
+#define INFLATE_MAX_MATCH 258
+#define INFLATE_MAX_BITS 15
+#define INFLATE_FAST_BITS 9
+#define INFLATE_NUM_LENGTHS 288
+#define INFLATE_NUM_DISTS 30
+
+/* canonical Huffman code; codes of up to INFLATE_FAST_BITS bits are also
+ * decoded through a lookup table whose entries are (length << 9) | symbol */
+struct huffman_t
+{
+    short count[INFLATE_MAX_BITS + 1];
+    short symbol[INFLATE_NUM_LENGTHS];
+    uint16_t fast[1 << INFLATE_FAST_BITS];
+};
+
+enum inflate_state_t
+{
+    INFLATE_HEADER,
+    INFLATE_BLOCK,
+    INFLATE_STORED,
+    INFLATE_HUFFMAN,
+    INFLATE_TRAILER,
+    INFLATE_DONE
+};
+
+enum inflate_format_t { INFLATE_GZIP, INFLATE_ZLIB };
+
+struct inflate_reader_t
+{
+    struct strrdr_t *src_reader;
+    enum inflate_state_t state;
+    enum inflate_format_t format;
+    int last_block;
+    size_t stored_left;
+
+    /* input bits, least significant first */
+    ro_seg_t in;
+    uint64_t bitbuf;
+    unsigned bitcnt;
+    int src_eof;
+
+    /* output; the INFLATE_WINDOW bytes before out_start stay around for
+     * back-references */
+    char *out;
+    size_t out_cap;
+    size_t out_limit;  /* out_start + buflen */
+    size_t out_pos;
+    size_t out_start;
+    size_t out_checked;  /* end of the data covered by checksum */
+    uint32_t checksum;
+    uint32_t size;       /* gzip ISIZE, the member's size mod 2^32 */
+
+    struct huffman_t lencode;
+    struct huffman_t distcode;
+    uint32_t crc_table[256];
+
+    int failed;
+    int src_failed;  /* the error comes from the source reader */
+    const char *error;
+};
+
+static const short length_base[29] = {
+    3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+    35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+};
+static const short length_extra[29] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+    3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+};
+static const short dist_base[30] = {
+    1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193,
+    257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145,
+    8193, 12289, 16385, 24577
+};
+static const short dist_extra[30] = {
+    0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6,
+    7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13
+};
+
+static int inflate_fail(struct inflate_reader_t *ir, const char *error)
+{
+    ir->failed = 1;
+    ir->error = error;
+    return -1;
+}
+
+/* checksums */
+
+static void crc32_init_table(uint32_t *table)
+{
+    uint32_t n, c;
+    int k;
+    for (n = 0; n < 256; ++n) {
+        c = n;
+        for (k = 0; k < 8; ++k)
+            c = c & 1 ? 0xedb88320 ^ (c >> 1) : c >> 1;
+        table[n] = c;
+    }
+}
+
+static uint32_t crc32_update(const uint32_t *table,
+                             uint32_t crc,
+                             const unsigned char *buf,
+                             size_t size)
+{
+    crc = ~crc;
+    while (size--)
+        crc = table[(crc ^ *buf++) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+static uint32_t adler32_update(uint32_t adler,
+                               const unsigned char *buf,
+                               size_t size)
+{
+    uint32_t a = adler & 0xffff, b = adler >> 16;
+    while (size > 0) {
+        /* the largest n for which the sums cannot overflow */
+        size_t n = size < 5552 ? size : 5552;
+        size -= n;
+        while (n--) {
+            a += *buf++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return (b << 16) | a;
+}
+
+static void inflate_update_checksum(struct inflate_reader_t *ir)
+{
+    const unsigned char *buf = (const unsigned char *)ir->out + ir->out_checked;
+    const size_t size = ir->out_pos - ir->out_checked;
+
+    if (ir->format == INFLATE_GZIP)
+        ir->checksum = crc32_update(ir->crc_table, ir->checksum, buf, size);
+    else
+        ir->checksum = adler32_update(ir->checksum, buf, size);
+    ir->size += (uint32_t)size;
+    ir->out_checked = ir->out_pos;
+}
+
+/* input bits */
+
+static int inflate_pull(struct inflate_reader_t *ir)
+{
+    int ret;
+    if (ir->src_eof)
+        return 0;
+
+    ret = strrdr_read(ir->src_reader, &ir->in);
+    if (ret < 0) {
+        ir->src_failed = 1;
+        inflate_fail(ir, "source read failed");
+    }
+    else if (ret == 0) {
+        ir->in.size = 0;
+        ir->src_eof = 1;
+    }
+    return ret;
+}
+
+/* loads as many input bytes into bitbuf as there is room for, if there are
+ * any; returns -1 only on a source error */
+static int inflate_fill(struct inflate_reader_t *ir)
+{
+    while (ir->bitcnt <= 56) {
+        if (ir->in.size == 0) {
+            const int ret = inflate_pull(ir);
+            if (ret < 0)
+                return -1;
+            if (ret == 0)
+                break;
+        }
+        ir->bitbuf |= (uint64_t)(unsigned char)*ir->in.start << ir->bitcnt;
+        ++ir->in.start;
+        --ir->in.size;
+        ir->bitcnt += 8;
+    }
+    return 0;
+}
+
+static int inflate_need(struct inflate_reader_t *ir, unsigned n)
+{
+    if (ir->bitcnt >= n)
+        return 0;
+    if (inflate_fill(ir) < 0)
+        return -1;
+    if (ir->bitcnt < n)
+        return inflate_fail(ir, "unexpected end of compressed data");
+    return 0;
+}
+
+static int inflate_bits(struct inflate_reader_t *ir, unsigned n, unsigned *val)
+{
+    if (inflate_need(ir, n) < 0)
+        return -1;
+    *val = (unsigned)(ir->bitbuf & (((uint64_t)1 << n) - 1));
+    ir->bitbuf >>= n;
+    ir->bitcnt -= n;
+    return 0;
+}
+
+static void inflate_align(struct inflate_reader_t *ir)
+{
+    const unsigned drop = ir->bitcnt & 7;
+    ir->bitbuf >>= drop;
+    ir->bitcnt -= drop;
+}
+
+/* n bytes, little endian (gzip) or big endian (zlib) */
+static int inflate_bytes(struct inflate_reader_t *ir,
+                         unsigned n,
+                         int big_endian,
+                         uint32_t *val)
+{
+    unsigned i, byte;
+    *val = 0;
+    for (i = 0; i < n; ++i) {
+        if (inflate_bits(ir, 8, &byte) < 0)
+            return -1;
+        if (big_endian)
+            *val = (*val << 8) | byte;
+        else
+            *val |= (uint32_t)byte << (8 * i);
+    }
+    return 0;
+}
+
+/* Huffman codes */
+
+static int huffman_build(struct huffman_t *h, const short *lengths, int n)
+{
+    short offs[INFLATE_MAX_BITS + 1];
+    unsigned next_code[INFLATE_MAX_BITS + 1];
+    unsigned code = 0;
+    int len, sym, left = 1;
+
+    memset(h->count, 0, sizeof(h->count));
+    memset(h->fast, 0, sizeof(h->fast));
+    for (sym = 0; sym < n; ++sym)
+        ++h->count[lengths[sym]];
+    if (h->count[0] == n)
+        return 0;  /* no codes; decoding will fail if one is used */
+
+    for (len = 1; len <= INFLATE_MAX_BITS; ++len) {
+        left = (left << 1) - h->count[len];
+        if (left < 0)
+            return -1;  /* over-subscribed */
+    }
+
+    offs[1] = 0;
+    for (len = 1; len < INFLATE_MAX_BITS; ++len)
+        offs[len + 1] = (short)(offs[len] + h->count[len]);
+    for (len = 1; len <= INFLATE_MAX_BITS; ++len) {
+        next_code[len] = code;
+        code = (code + (unsigned)h->count[len]) << 1;
+    }
+
+    for (sym = 0; sym < n; ++sym) {
+        const int l = lengths[sym];
+        if (l == 0)
+            continue;
+        h->symbol[offs[l]++] = (short)sym;
+        if (l <= INFLATE_FAST_BITS) {
+            unsigned c = next_code[l], rev = 0, i;
+            int b;
+            for (b = 0; b < l; ++b, c >>= 1)
+                rev = (rev << 1) | (c & 1);
+            for (i = rev; i < (1u << INFLATE_FAST_BITS); i += 1u << l)
+                h->fast[i] = (uint16_t)((l << 9) | sym);
+        }
+        ++next_code[l];
+    }
+    return 0;
+}
+
+static int huffman_decode(struct inflate_reader_t *ir, const struct huffman_t *h)
+{
+    int code = 0, first = 0, index = 0, len;
+    unsigned entry;
+
+    if (ir->bitcnt < INFLATE_MAX_BITS && inflate_fill(ir) < 0)
+        return -1;
+
+    entry = h->fast[ir->bitbuf & ((1u << INFLATE_FAST_BITS) - 1)];
+    if (entry != 0 && (entry >> 9) <= ir->bitcnt) {
+        ir->bitbuf >>= entry >> 9;
+        ir->bitcnt -= entry >> 9;
+        return (int)(entry & 511);
+    }
+
+    /* longer codes are decoded a bit at a time */
+    for (len = 1; len <= INFLATE_MAX_BITS; ++len) {
+        unsigned bit;
+        int count;
+        if (inflate_bits(ir, 1, &bit) < 0)
+            return -1;
+        code |= (int)bit;
+        count = h->count[len];
+        if (code - count < first)
+            return h->symbol[index + (code - first)];
+        index += count;
+        first += count;
+        first <<= 1;
+        code <<= 1;
+    }
+    return inflate_fail(ir, "invalid Huffman code");
+}
+
+static void inflate_fixed_codes(struct inflate_reader_t *ir)
+{
+    short lengths[INFLATE_NUM_LENGTHS];
+    int sym;
+
+    for (sym = 0; sym < 144; ++sym)
+        lengths[sym] = 8;
+    for (; sym < 256; ++sym)
+        lengths[sym] = 9;
+    for (; sym < 280; ++sym)
+        lengths[sym] = 7;
+    for (; sym < INFLATE_NUM_LENGTHS; ++sym)
+        lengths[sym] = 8;
+    huffman_build(&ir->lencode, lengths, INFLATE_NUM_LENGTHS);
+
+    for (sym = 0; sym < INFLATE_NUM_DISTS; ++sym)
+        lengths[sym] = 5;
+    huffman_build(&ir->distcode, lengths, INFLATE_NUM_DISTS);
+}
+
+static int inflate_dynamic_codes(struct inflate_reader_t *ir)
+{
+    static const short order[19] = {
+        16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15
+    };
+    short lengths[INFLATE_NUM_LENGTHS + INFLATE_NUM_DISTS];
+    unsigned nlen, ndist, ncode, i, n;
+
+    if (inflate_bits(ir, 5, &nlen) < 0 ||
+            inflate_bits(ir, 5, &ndist) < 0 ||
+            inflate_bits(ir, 4, &ncode) < 0)
+        return -1;
+    nlen += 257;
+    ndist += 1;
+    ncode += 4;
+    if (nlen > 286 || ndist > INFLATE_NUM_DISTS)
+        return inflate_fail(ir, "invalid code counts");
+
+    memset(lengths, 0, sizeof(lengths));
+    for (i = 0; i < ncode; ++i) {
+        unsigned len;
+        if (inflate_bits(ir, 3, &len) < 0)
+            return -1;
+        lengths[order[i]] = (short)len;
+    }
+    if (huffman_build(&ir->lencode, lengths, 19) < 0)
+        return inflate_fail(ir, "invalid code lengths code");
+
+    for (n = 0; n < nlen + ndist; ) {
+        int sym = huffman_decode(ir, &ir->lencode);
+        unsigned repeat;
+        short len = 0;
+
+        if (sym < 0)
+            return -1;
+        if (sym < 16) {
+            lengths[n++] = (short)sym;
+            continue;
+        }
+
+        if (sym == 16) {
+            if (n == 0)
+                return inflate_fail(ir, "repeat with no first length");
+            len = lengths[n - 1];
+            if (inflate_bits(ir, 2, &repeat) < 0)
+                return -1;
+            repeat += 3;
+        }
+        else if (sym == 17) {
+            if (inflate_bits(ir, 3, &repeat) < 0)
+                return -1;
+            repeat += 3;
+        }
+        else {
+            if (inflate_bits(ir, 7, &repeat) < 0)
+                return -1;
+            repeat += 11;
+        }
+        if (n + repeat > nlen + ndist)
+            return inflate_fail(ir, "too many code lengths");
+        while (repeat--)
+            lengths[n++] = len;
+    }
+
+    if (lengths[256] == 0)
+        return inflate_fail(ir, "missing end-of-block code");
+    if (huffman_build(&ir->lencode, lengths, (int)nlen) < 0 ||
+            huffman_build(&ir->distcode, lengths + nlen, (int)ndist) < 0)
+        return inflate_fail(ir, "invalid literal/length or distance code");
+    return 0;
+}
+
+/* stream framing */
+
+static int inflate_skip_zero_terminated(struct inflate_reader_t *ir)
+{
+    unsigned byte;
+    do {
+        if (inflate_bits(ir, 8, &byte) < 0)
+            return -1;
+    } while (byte != 0);
+    return 0;
+}
+
+static int inflate_header(struct inflate_reader_t *ir)
+{
+    unsigned b0, b1;
+
+    if (inflate_bits(ir, 8, &b0) < 0 || inflate_bits(ir, 8, &b1) < 0)
+        return -1;
+
+    if (b0 == 0x1f && b1 == 0x8b) {
+        unsigned method, flags;
+        uint32_t skip;
+
+        ir->format = INFLATE_GZIP;
+        if (inflate_bits(ir, 8, &method) < 0 || inflate_bits(ir, 8, &flags) < 0)
+            return -1;
+        if (method != 8 || (flags & 0xe0) != 0)
+            return inflate_fail(ir, "unsupported gzip header");
+        /* MTIME, XFL and OS */
+        if (inflate_bytes(ir, 4, 0, &skip) < 0 || inflate_bytes(ir, 2, 0, &skip) < 0)
+            return -1;
+        if (flags & 4) {  /* FEXTRA */
+            uint32_t xlen;
+            if (inflate_bytes(ir, 2, 0, &xlen) < 0)
+                return -1;
+            while (xlen--) {
+                if (inflate_bytes(ir, 1, 0, &skip) < 0)
+                    return -1;
+            }
+        }
+        if ((flags & 8) && inflate_skip_zero_terminated(ir) < 0)  /* FNAME */
+            return -1;
+        if ((flags & 16) && inflate_skip_zero_terminated(ir) < 0)  /* FCOMMENT */
+            return -1;
+        if ((flags & 2) && inflate_bytes(ir, 2, 0, &skip) < 0)  /* FHCRC */
+            return -1;
+        ir->checksum = 0;
+    }
+    else if ((b0 & 0x0f) == 8 && (b0 >> 4) <= 7 && (b0 * 256 + b1) % 31 == 0) {
+        ir->format = INFLATE_ZLIB;
+        if (b1 & 0x20)
+            return inflate_fail(ir, "zlib preset dictionaries are not supported");
+        ir->checksum = 1;
+    }
+    else
+        return inflate_fail(ir, "not gzip or zlib data");
+
+    ir->size = 0;
+    ir->state = INFLATE_BLOCK;
+    return 0;
+}
+
+static int inflate_trailer(struct inflate_reader_t *ir)
+{
+    uint32_t checksum, size;
+
+    inflate_align(ir);
+    inflate_update_checksum(ir);
+    if (ir->format == INFLATE_GZIP) {
+        if (inflate_bytes(ir, 4, 0, &checksum) < 0 ||
+                inflate_bytes(ir, 4, 0, &size) < 0)
+            return -1;
+        if (checksum != ir->checksum || size != ir->size)
+            return inflate_fail(ir, "gzip CRC or size mismatch");
+
+        /* another member may follow */
+        if (inflate_fill(ir) < 0)
+            return -1;
+        ir->state = ir->bitcnt == 0 ? INFLATE_DONE : INFLATE_HEADER;
+    }
+    else {
+        if (inflate_bytes(ir, 4, 1, &checksum) < 0)
+            return -1;
+        if (checksum != ir->checksum)
+            return inflate_fail(ir, "zlib Adler-32 mismatch");
+        ir->state = INFLATE_DONE;
+    }
+    return 0;
+}
+
+static int inflate_block_header(struct inflate_reader_t *ir)
+{
+    unsigned last, type;
+
+    if (inflate_bits(ir, 1, &last) < 0 || inflate_bits(ir, 2, &type) < 0)
+        return -1;
+    ir->last_block = (int)last;
+
+    if (type == 0) {
+        uint32_t len, nlen;
+        inflate_align(ir);
+        if (inflate_bytes(ir, 2, 0, &len) < 0 || inflate_bytes(ir, 2, 0, &nlen) < 0)
+            return -1;
+        if (len != (~nlen & 0xffff))
+            return inflate_fail(ir, "stored block length mismatch");
+        ir->stored_left = len;
+        ir->state = INFLATE_STORED;
+    }
+    else if (type == 1) {
+        inflate_fixed_codes(ir);
+        ir->state = INFLATE_HUFFMAN;
+    }
+    else if (type == 2) {
+        if (inflate_dynamic_codes(ir) < 0)
+            return -1;
+        ir->state = INFLATE_HUFFMAN;
+    }
+    else
+        return inflate_fail(ir, "invalid block type");
+    return 0;
+}
+
+static void inflate_end_block(struct inflate_reader_t *ir)
+{
+    ir->state = ir->last_block ? INFLATE_TRAILER : INFLATE_BLOCK;
+}
+
+/* block contents; both return 1 when the output buffer is full */
+
+static int inflate_stored(struct inflate_reader_t *ir)
+{
+    while (ir->stored_left > 0) {
+        size_t n;
+        if (ir->out_pos == ir->out_limit)
+            return 1;
+
+        if (ir->bitcnt > 0) {
+            /* bytes already loaded into the bit buffer come first */
+            unsigned byte;
+            if (inflate_bits(ir, 8, &byte) < 0)
+                return -1;
+            ir->out[ir->out_pos++] = (char)byte;
+            --ir->stored_left;
+            continue;
+        }
+
+        if (ir->in.size == 0) {
+            const int ret = inflate_pull(ir);
+            if (ret < 0)
+                return -1;
+            if (ret == 0)
+                return inflate_fail(ir, "unexpected end of compressed data");
+        }
+        n = ir->stored_left;
+        if (n > ir->in.size)
+            n = ir->in.size;
+        if (n > ir->out_limit - ir->out_pos)
+            n = ir->out_limit - ir->out_pos;
+        memcpy(ir->out + ir->out_pos, ir->in.start, n);
+        ir->out_pos += n;
+        ir->in.start += n;
+        ir->in.size -= n;
+        ir->stored_left -= n;
+    }
+    inflate_end_block(ir);
+    return 0;
+}
+
+static int inflate_huffman(struct inflate_reader_t *ir)
+{
+    while (ir->out_limit - ir->out_pos >= INFLATE_MAX_MATCH) {
+        int sym = huffman_decode(ir, &ir->lencode);
+        unsigned extra, len, dist;
+
+        if (sym < 0)
+            return -1;
+        if (sym < 256) {
+            ir->out[ir->out_pos++] = (char)sym;
+            continue;
+        }
+        if (sym == 256) {
+            inflate_end_block(ir);
+            return 0;
+        }
+
+        sym -= 257;
+        if (sym >= 29)
+            return inflate_fail(ir, "invalid length symbol");
+        if (inflate_bits(ir, (unsigned)length_extra[sym], &extra) < 0)
+            return -1;
+        len = (unsigned)length_base[sym] + extra;
+
+        sym = huffman_decode(ir, &ir->distcode);
+        if (sym < 0)
+            return -1;
+        if (sym >= INFLATE_NUM_DISTS)
+            return inflate_fail(ir, "invalid distance symbol");
+        if (inflate_bits(ir, (unsigned)dist_extra[sym], &extra) < 0)
+            return -1;
+        dist = (unsigned)dist_base[sym] + extra;
+        if (dist > ir->out_pos)
+            return inflate_fail(ir, "distance too far back");
+
+        {
+            char *dst = ir->out + ir->out_pos;
+            const char *src = dst - dist;
+            ir->out_pos += len;
+            if (dist >= len)
+                memcpy(dst, src, len);
+            else {
+                /* overlapping copy repeats the last dist bytes */
+                while (len--)
+                    *dst++ = *src++;
+            }
+        }
+    }
+    return 1;
+}
+
+static int inflate_reader_open(void *data)
+{
+    struct inflate_reader_t *ir = (struct inflate_reader_t *)data;
+    return strrdr_open(ir->src_reader);
+}
+
+static int inflate_reader_read(void *data, ro_seg_t *seg)
+{
+    struct inflate_reader_t *ir = (struct inflate_reader_t *)data;
+    int full = 0;
+
+    if (ir->failed)
+        return -1;
+
+    /* keep just the window of already returned output */
+    if (ir->out_pos > INFLATE_WINDOW) {
+        memmove(ir->out, ir->out + ir->out_pos - INFLATE_WINDOW, INFLATE_WINDOW);
+        ir->out_pos = ir->out_start = ir->out_checked = INFLATE_WINDOW;
+    }
+    ir->out_limit = ir->out_start + ir->out_cap - INFLATE_WINDOW;
+
+    while (!full && ir->state != INFLATE_DONE) {
+        int ret = 0;
+        switch (ir->state) {
+        case INFLATE_HEADER:
+            ret = inflate_header(ir);
+            break;
+        case INFLATE_BLOCK:
+            ret = inflate_block_header(ir);
+            break;
+        case INFLATE_STORED:
+            ret = inflate_stored(ir);
+            break;
+        case INFLATE_HUFFMAN:
+            ret = inflate_huffman(ir);
+            break;
+        case INFLATE_TRAILER:
+            ret = inflate_trailer(ir);
+            break;
+        default:
+            assert(0);
+        }
+        if (ret < 0)
+            return -1;
+        full = ret;
+    }
+
+    if (ir->out_pos == ir->out_start)
+        return 0;
+
+    inflate_update_checksum(ir);
+    seg->start = ir->out + ir->out_start;
+    seg->size = ir->out_pos - ir->out_start;
+    ir->out_start = ir->out_pos;
+    return (int)seg->size;
+}
+
+static void inflate_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    struct inflate_reader_t *ir = (struct inflate_reader_t *)data;
+    if (ir->src_failed) {
+        strrdr_get_error(ir->src_reader, buf, errnum);
+        return;
+    }
+    *buf = ir->error;
+    *errnum = 0;
+}
+
+void po_inflate_reader_init(struct strrdr_t *reader,
+                            struct strrdr_t *src_reader,
+                            size_t buflen)
+{
+    struct inflate_reader_t *ir = (struct inflate_reader_t *)malloc(sizeof(struct inflate_reader_t));
+    assert(reader != NULL);
+    assert(buflen >= INFLATE_READER_MIN_BUFLEN && buflen <= INT_MAX);
+    ir->src_reader = src_reader;
+    ir->state = INFLATE_HEADER;
+    ir->format = INFLATE_GZIP;
+    ir->last_block = 0;
+    ir->stored_left = 0;
+    ir->in.start = NULL;
+    ir->in.size = 0;
+    ir->bitbuf = 0;
+    ir->bitcnt = 0;
+    ir->src_eof = 0;
+    ir->out_cap = INFLATE_WINDOW + buflen;
+    ir->out = (char *)malloc(ir->out_cap);
+    ir->out_limit = 0;
+    ir->out_pos = ir->out_start = ir->out_checked = 0;
+    ir->checksum = 0;
+    ir->size = 0;
+    crc32_init_table(ir->crc_table);
+    ir->failed = 0;
+    ir->src_failed = 0;
+    ir->error = "";
+    reader->data = ir;
+    reader->open = inflate_reader_open;
+    reader->read = inflate_reader_read;
+    reader->get_error = inflate_reader_get_error;
+}
+
+void po_inflate_reader_uninit(struct strrdr_t *reader)
+{
+    struct inflate_reader_t *ir = (struct inflate_reader_t *)reader->data;
+    free(ir->out);
+    free(ir);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INFLATE_H
+#define INFLATE_H
+
+#include "io.h"
+
+/* Decompressing reader: wraps a source reader which produces gzip (RFC 1952,
+ * including concatenated members) or zlib (RFC 1950) data, detected from the
+ * first bytes, and returns the decompressed data in segments of up to buflen
+ * bytes.  The output buffer is allocated once and reused; a segment stays
+ * valid until the next read.  Checksums are verified at the end of each
+ * stream.
+ *
+ * The decoder is self-contained, so zlib is not needed. */
+
+#define INFLATE_READER_BUFLEN (256 * 1024)
+/* buflen must be at least this much, so that any match fits */
+#define INFLATE_READER_MIN_BUFLEN 1024
+
+void po_inflate_reader_init(struct strrdr_t *reader,
+                            struct strrdr_t *src_reader,
+                            size_t buflen);
+void po_inflate_reader_uninit(struct strrdr_t *reader);
+
+#endif  /* INFLATE_H */
@@ -0,0 +1,167 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "intern.h"
+#include "hash.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#define INTERN_TABLE_INIT_CAPACITY 64
+#define INTERN_ARENA_BLOCK_SIZE (64 * 1024)
+
+uint64_t intern_hash(const ro_seg_t *key)
+{
+    return ro_seg_hash(key, 0);
+}
+
+static int intern_str_equals(const intern_str_t *istr,
+                             const ro_seg_t *key,
+                             uint64_t hash)
+{
+    return istr->hash == hash &&
+        istr->size == key->size &&
+        memcmp(istr->start, key->start, key->size) == 0;
+}
+
+void intern_table_init(intern_table_t *table)
+{
+    table->capacity = INTERN_TABLE_INIT_CAPACITY;
+    table->size = 0;
+    table->slots = (const intern_str_t **)
+        calloc(table->capacity, sizeof(intern_str_t *));
+    arena_init(&table->arena, INTERN_ARENA_BLOCK_SIZE);
+    mutex_init(&table->lock);
+}
+
+void intern_table_uninit(intern_table_t *table)
+{
+    free((void *)table->slots);
+    arena_uninit(&table->arena);
+    mutex_uninit(&table->lock);
+}
+
+size_t intern_table_size(intern_table_t *table)
+{
+    return table->size;
+}
+
+/* returns the slot holding key, or the empty slot where it belongs */
+static const intern_str_t **intern_table_probe(intern_table_t *table,
+                                               const ro_seg_t *key,
+                                               uint64_t hash)
+{
+    const size_t mask = table->capacity - 1;
+    size_t i = (size_t)hash & mask;
+    while (table->slots[i] != NULL &&
+           !intern_str_equals(table->slots[i], key, hash))
+        i = (i + 1) & mask;
+    return &table->slots[i];
+}
+
+static void intern_table_grow(intern_table_t *table)
+{
+    const intern_str_t **old_slots = table->slots;
+    const size_t old_capacity = table->capacity;
+    size_t i;
+
+    table->capacity *= 2;
+    table->slots = (const intern_str_t **)
+        calloc(table->capacity, sizeof(intern_str_t *));
+
+    for (i = 0; i < old_capacity; ++i) {
+        const intern_str_t *istr = old_slots[i];
+        if (istr != NULL) {
+            size_t j = (size_t)istr->hash & (table->capacity - 1);
+            while (table->slots[j] != NULL)
+                j = (j + 1) & (table->capacity - 1);
+            table->slots[j] = istr;
+        }
+    }
+
+    free((void *)old_slots);
+}
+
+static const intern_str_t *intern_table_find_hashed(intern_table_t *table,
+                                                    const ro_seg_t *key,
+                                                    uint64_t hash)
+{
+    return *intern_table_probe(table, key, hash);
+}
+
+static const intern_str_t *intern_table_intern_hashed(intern_table_t *table,
+                                                      const ro_seg_t *key,
+                                                      uint64_t hash)
+{
+    const intern_str_t **slot = intern_table_probe(table, key, hash);
+    intern_str_t *istr;
+    char *contents;
+
+    if (*slot != NULL)
+        return *slot;
+
+    /* the handle and its contents live in the arena, so they never move */
+    istr = (intern_str_t *)arena_alloc(&table->arena, sizeof(intern_str_t));
+    contents = (char *)arena_alloc(&table->arena, key->size + 1);
+    memcpy(contents, key->start, key->size);
+    contents[key->size] = '\0';
+    istr->start = contents;
+    istr->size = key->size;
+    istr->hash = hash;
+    *slot = istr;
+
+    /* keep the load factor at or below 1/2 */
+    if (++table->size * 2 > table->capacity)
+        intern_table_grow(table);
+
+    return istr;
+}
+
+const intern_str_t *intern_table_find(intern_table_t *table,
+                                      const ro_seg_t *key)
+{
+    return intern_table_find_hashed(table, key, intern_hash(key));
+}
+
+const intern_str_t *intern_table_intern(intern_table_t *table,
+                                        const ro_seg_t *key)
+{
+    return intern_table_intern_hashed(table, key, intern_hash(key));
+}
+
+/* intern_cache_t */
+
+void intern_cache_init(intern_cache_t *cache, intern_table_t *table)
+{
+    cache->table = table;
+    memset((void *)cache->entries, 0, sizeof(cache->entries));
+}
+
+const intern_str_t *intern_cache_intern(intern_cache_t *cache,
+                                        const ro_seg_t *key)
+{
+    const uint64_t hash = intern_hash(key);
+    const intern_str_t **entry =
+        &cache->entries[(size_t)(hash >> 32) & (INTERN_CACHE_SIZE - 1)];
+
+    if (*entry == NULL || !intern_str_equals(*entry, key, hash)) {
+        mutex_lock(&cache->table->lock);
+        *entry = intern_table_intern_hashed(cache->table, key, hash);
+        mutex_unlock(&cache->table->lock);
+    }
+
+    return *entry;
+}
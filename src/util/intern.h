@@ -0,0 +1,73 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "str.h"
+#include "alloc.h"
+#include "thread.h"
+#include "types.h"
+
+/* An interned string.  The table hands out exactly one intern_str_t per
+ * distinct string, so interned strings can be compared by pointer.  The
+ * handles (and the null-terminated contents) stay valid until the table is
+ * uninitialized. */
+typedef struct _intern_str_t
+{
+    const char *start;
+    size_t size;
+    uint64_t hash;
+} intern_str_t;
+
+/* intern_table_t: not thread-safe by itself; threads that share a table
+ * should go through their own intern_cache_t */
+typedef struct _intern_table_t
+{
+    const intern_str_t **slots;
+    size_t capacity;  /* always a power of 2 */
+    size_t size;
+    struct arena_t arena;
+    mutex_t lock;  /* taken by intern_cache_t on a miss */
+} intern_table_t;
+
+void intern_table_init(intern_table_t *table);
+void intern_table_uninit(intern_table_t *table);
+size_t intern_table_size(intern_table_t *table);
+/* returns NULL if key was not interned; never allocates */
+const intern_str_t *intern_table_find(intern_table_t *table,
+                                      const ro_seg_t *key);
+const intern_str_t *intern_table_intern(intern_table_t *table,
+                                        const ro_seg_t *key);
+uint64_t intern_hash(const ro_seg_t *key);
+
+/* intern_cache_t: per-thread, direct-mapped front cache of a shared
+ * intern_table_t.  Hits do not touch the table at all; misses intern the key
+ * in the table under its lock. */
+
+#define INTERN_CACHE_SIZE 1024
+
+typedef struct _intern_cache_t
+{
+    intern_table_t *table;
+    const intern_str_t *entries[INTERN_CACHE_SIZE];
+} intern_cache_t;
+
+void intern_cache_init(intern_cache_t *cache, intern_table_t *table);
+const intern_str_t *intern_cache_intern(intern_cache_t *cache,
+                                        const ro_seg_t *key);
+
+#endif  /* INTERN_H */
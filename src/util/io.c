@@ -15,9 +15,26 @@
  */
 
 #include "io.h"
+#include "scan.h"
+#include "types.h"
 #include <stdio.h>
-#include <windows.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
 #include <assert.h>
+#ifdef _WIN32
+#include <windows.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <errno.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#endif
 
 int strrdr_open(struct strrdr_t *reader)
 {
@@ -34,67 +51,186 @@ void strrdr_get_error(struct strrdr_t *reader, const char **error, int *errnum)
     reader->get_error(reader->data, error, errnum);
 }
 
+int strrdr_count_lines(struct strrdr_t *reader, uint64_t *lines)
+{
+    ro_seg_t seg;
+    int ret;
+
+    *lines = 0;
+    while ((ret = strrdr_read(reader, &seg)) > 0)
+        *lines += ro_seg_count_byte(&seg, '\n');
+
+    return ret;
+}
+
 /* file reader */
 
-#define FILE_READER_BUFLEN 1024
+#define FILE_READER_BUFLEN (64 * 1024)
 
 struct file_reader_t
 {
     char *path;
+#ifdef _WIN32
     FILE *fp;
+#else
+    int fd;
+#endif
     int errnum;
-    char *error;
-    char buf[FILE_READER_BUFLEN];
+    const char *error;
+    char *buf;
+    size_t buflen;
+    uint64_t pos;  /* reads stop at end */
+    uint64_t end;
 };
 
+static size_t file_reader_next_size(struct file_reader_t *fr)
+{
+    if ((uint64_t)fr->buflen > fr->end - fr->pos)
+        return (size_t)(fr->end - fr->pos);
+    return fr->buflen;
+}
+
+#ifdef _WIN32
+
 static int file_reader_open(void *data)
 {
     struct file_reader_t *fr = (struct file_reader_t *)data;
     fr->fp = fopen(fr->path, "rb");
     if (fr->fp == NULL) {
         fr->errnum = GetLastError();
-        fr->error = "";
+        fr->error = "fopen failed";
+        return -1;
+    }
+    if (fr->pos > 0 && _fseeki64(fr->fp, (__int64)fr->pos, SEEK_SET) != 0) {
+        fr->errnum = GetLastError();
+        fr->error = "fseek failed";
         return -1;
     }
     return 0;
 }
 
-/* could be overriden for unit test purposes */
-size_t file_reader_read_buflen = FILE_READER_BUFLEN;
-
 static int file_reader_read(void *data, ro_seg_t *seg)
 {
     struct file_reader_t *fr = (struct file_reader_t *)data;
-    int ret = (int)fread(fr->buf, 1, file_reader_read_buflen, fr->fp);
+    int ret = (int)fread(fr->buf, 1, file_reader_next_size(fr), fr->fp);
     if (ret > 0) {
         seg->start = fr->buf;
         seg->size = (size_t)ret;
+        fr->pos += (uint64_t)ret;
+    }
+    else if (ferror(fr->fp)) {
+        fr->errnum = GetLastError();
+        fr->error = "fread failed";
+        ret = -1;
     }
 
     return ret;
 }
 
+static void file_reader_close(struct file_reader_t *fr)
+{
+    if (fr->fp != NULL)
+        fclose(fr->fp);
+}
+
+#else  /* POSIX */
+
+static int file_reader_open(void *data)
+{
+    struct file_reader_t *fr = (struct file_reader_t *)data;
+    fr->fd = open(fr->path, O_RDONLY);
+    if (fr->fd < 0) {
+        fr->errnum = errno;
+        fr->error = "open failed";
+        return -1;
+    }
+    if (fr->pos > 0 && lseek(fr->fd, (off_t)fr->pos, SEEK_SET) < 0) {
+        fr->errnum = errno;
+        fr->error = "lseek failed";
+        return -1;
+    }
+
+#ifdef POSIX_FADV_SEQUENTIAL
+    /* only a hint, so failures are ignored */
+    posix_fadvise(fr->fd, (off_t)fr->pos,
+                  fr->end == UINT64_MAX ? 0 : (off_t)(fr->end - fr->pos),
+                  POSIX_FADV_SEQUENTIAL);
+#endif
+    return 0;
+}
+
+static int file_reader_read(void *data, ro_seg_t *seg)
+{
+    struct file_reader_t *fr = (struct file_reader_t *)data;
+    ssize_t ret;
+
+    do {
+        ret = read(fr->fd, fr->buf, file_reader_next_size(fr));
+    } while (ret < 0 && errno == EINTR);
+
+    if (ret > 0) {
+        seg->start = fr->buf;
+        seg->size = (size_t)ret;
+        fr->pos += (uint64_t)ret;
+    }
+    else if (ret < 0) {
+        fr->errnum = errno;
+        fr->error = "read failed";
+        return -1;
+    }
+
+    return (int)ret;
+}
+
+static void file_reader_close(struct file_reader_t *fr)
+{
+    if (fr->fd >= 0)
+        close(fr->fd);
+}
+
+#endif  /* _WIN32 */
+
 static void file_reader_get_error(void *data, const char **buf, int *errnum)
 {
     struct file_reader_t *fr = (struct file_reader_t *)data;
-    *buf = "Got error";
+    *buf = fr->error;
     *errnum = fr->errnum;
 }
 
-static char *dup_str(const char *src)
+void po_file_reader_init(struct strrdr_t *reader, const char *path)
 {
-    size_t len = strlen(src);
-    char *dup = (char *)malloc(len + 1);
-    memcpy(dup, src, len + 1);
-    return dup;
+    po_file_reader_init_buflen(reader, path, FILE_READER_BUFLEN);
 }
 
-void po_file_reader_init(struct strrdr_t *reader, const char *path)
+void po_file_reader_init_buflen(struct strrdr_t *reader,
+                                const char *path,
+                                size_t buflen)
+{
+    po_file_reader_init_range(reader, path, 0, UINT64_MAX, buflen);
+}
+
+void po_file_reader_init_range(struct strrdr_t *reader,
+                               const char *path,
+                               uint64_t begin,
+                               uint64_t end,
+                               size_t buflen)
 {
     struct file_reader_t *fr = (struct file_reader_t *)malloc(sizeof(struct file_reader_t));
     assert(reader != NULL);
+    assert(buflen > 0 && buflen <= INT_MAX);
+    assert(begin <= end);
     fr->path = dup_str(path);
+#ifdef _WIN32
     fr->fp = NULL;
+#else
+    fr->fd = -1;
+#endif
+    fr->errnum = 0;
+    fr->error = "";
+    fr->buf = (char *)malloc(buflen);
+    fr->buflen = buflen;
+    fr->pos = begin;
+    fr->end = end;
     reader->data = fr;
     reader->open = file_reader_open;
     reader->read = file_reader_read;
@@ -104,17 +240,636 @@ void po_file_reader_init(struct strrdr_t *reader, const char *path)
 void po_file_reader_uninit(struct strrdr_t *reader)
 {
     struct file_reader_t *fr = (struct file_reader_t *)reader->data;
-    if (fr->fp != NULL)
-        fclose(fr->fp);
+    file_reader_close(fr);
+    free(fr->buf);
+    free(fr->path);
     free(fr);
 }
 
+/* file splitter */
+
+#define FILE_SPLIT_PROBE_BUFLEN 4096
+
+static int file_get_size(const char *path, uint64_t *size, int *errnum)
+{
+#ifdef _WIN32
+    struct _stati64 st;
+    if (_stati64(path, &st) != 0) {
+#else
+    struct stat st;
+    if (stat(path, &st) != 0) {
+#endif
+        *errnum = errno;
+        return -1;
+    }
+    *size = (uint64_t)st.st_size;
+    return 0;
+}
+
+/* returns the offset right after the first newline at or after pos - 1, so
+ * that a line starting exactly at pos is not skipped */
+static int file_find_line_start(const char *path,
+                                uint64_t pos,
+                                uint64_t size,
+                                uint64_t *line_start,
+                                int *errnum)
+{
+    struct strrdr_t fr;
+    const char *error;
+    ro_seg_t seg;
+    uint64_t offset = pos - 1;
+    int ret;
+
+    *line_start = size;
+    po_file_reader_init_range(&fr, path, offset, size, FILE_SPLIT_PROBE_BUFLEN);
+    if ((ret = strrdr_open(&fr)) < 0)
+        goto done;
+    while ((ret = strrdr_read(&fr, &seg)) > 0) {
+        const size_t found = ro_seg_find_byte(&seg, '\n');
+        if (found < seg.size) {
+            *line_start = offset + found + 1;
+            break;
+        }
+        offset += seg.size;
+    }
+
+done:
+    if (ret < 0)
+        strrdr_get_error(&fr, &error, errnum);
+    po_file_reader_uninit(&fr);
+    return ret < 0 ? ret : 0;
+}
+
+int file_split_lines(const char *path,
+                     uint64_t *bounds,
+                     size_t n,
+                     int *errnum)
+{
+    uint64_t size;
+    size_t i;
+
+    assert(n > 0);
+    *errnum = 0;
+    if (file_get_size(path, &size, errnum) < 0)
+        return -1;
+
+    bounds[0] = 0;
+    for (i = 1; i < n; ++i) {
+        const uint64_t target = size / n * i + size % n * i / n;
+        if (target <= bounds[i-1])
+            bounds[i] = bounds[i-1];  /* the previous line covers this range */
+        else if (file_find_line_start(path, target, size, &bounds[i], errnum) < 0)
+            return -1;
+    }
+    bounds[n] = size;
+    return 0;
+}
+
+/* mmap reader */
+
+#define MMAP_READER_WINDOW (64 * 1024 * 1024)
+
+struct mmap_reader_t
+{
+    char *path;
+#ifdef _WIN32
+    HANDLE file;
+    HANDLE mapping;
+#else
+    int fd;
+#endif
+    int errnum;
+    const char *error;
+    uint64_t file_size;
+    uint64_t offset;
+    size_t window;
+    void *view;
+    size_t view_size;
+};
+
+/* could be overriden for unit test purposes; rounded up to the mapping
+ * granularity when the file is opened, and capped so that a window's size
+ * still fits the int a read returns */
+size_t mmap_reader_window = MMAP_READER_WINDOW;
+
+static size_t mmap_reader_round_window(size_t granularity)
+{
+    const size_t max_window = (size_t)INT_MAX / granularity * granularity;
+    size_t window = mmap_reader_window;
+    if (window < granularity)
+        return granularity;
+    if (window > max_window)
+        return max_window;
+    return (window + granularity - 1) / granularity * granularity;
+}
+
+#ifdef _WIN32
+
+static int mmap_reader_open(void *data)
+{
+    struct mmap_reader_t *mr = (struct mmap_reader_t *)data;
+    LARGE_INTEGER size;
+    SYSTEM_INFO info;
+
+    mr->file = CreateFileA(mr->path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                           OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (mr->file == INVALID_HANDLE_VALUE) {
+        mr->error = "CreateFile failed";
+        goto error;
+    }
+
+    if (!GetFileSizeEx(mr->file, &size)) {
+        mr->error = "GetFileSizeEx failed";
+        goto error;
+    }
+    mr->file_size = (uint64_t)size.QuadPart;
+
+    GetSystemInfo(&info);
+    mr->window = mmap_reader_round_window(info.dwAllocationGranularity);
+
+    /* an empty file cannot be mapped */
+    if (mr->file_size > 0) {
+        mr->mapping = CreateFileMapping(mr->file, NULL, PAGE_READONLY,
+                                        0, 0, NULL);
+        if (mr->mapping == NULL) {
+            mr->error = "CreateFileMapping failed";
+            goto error;
+        }
+    }
+    return 0;
+
+error:
+    mr->errnum = (int)GetLastError();
+    return -1;
+}
+
+static void mmap_reader_unmap(struct mmap_reader_t *mr)
+{
+    if (mr->view != NULL) {
+        UnmapViewOfFile(mr->view);
+        mr->view = NULL;
+    }
+}
+
+static int mmap_reader_map(struct mmap_reader_t *mr, size_t size)
+{
+    mr->view = MapViewOfFile(mr->mapping, FILE_MAP_READ,
+                             (DWORD)(mr->offset >> 32),
+                             (DWORD)(mr->offset & 0xffffffff),
+                             size);
+    if (mr->view == NULL) {
+        mr->errnum = (int)GetLastError();
+        mr->error = "MapViewOfFile failed";
+        return -1;
+    }
+    return 0;
+}
+
+static void mmap_reader_close(struct mmap_reader_t *mr)
+{
+    mmap_reader_unmap(mr);
+    if (mr->mapping != NULL)
+        CloseHandle(mr->mapping);
+    if (mr->file != INVALID_HANDLE_VALUE)
+        CloseHandle(mr->file);
+}
+
+#else  /* POSIX */
+
+static int mmap_reader_open(void *data)
+{
+    struct mmap_reader_t *mr = (struct mmap_reader_t *)data;
+    struct stat st;
+
+    mr->fd = open(mr->path, O_RDONLY);
+    if (mr->fd < 0) {
+        mr->error = "open failed";
+        goto error;
+    }
+
+    if (fstat(mr->fd, &st) < 0) {
+        mr->error = "fstat failed";
+        goto error;
+    }
+    mr->file_size = (uint64_t)st.st_size;
+    mr->window = mmap_reader_round_window((size_t)sysconf(_SC_PAGESIZE));
+    return 0;
+
+error:
+    mr->errnum = errno;
+    return -1;
+}
+
+static void mmap_reader_unmap(struct mmap_reader_t *mr)
+{
+    if (mr->view != NULL) {
+        munmap(mr->view, mr->view_size);
+        mr->view = NULL;
+    }
+}
+
+static int mmap_reader_map(struct mmap_reader_t *mr, size_t size)
+{
+    void *view = mmap(NULL, size, PROT_READ, MAP_PRIVATE, mr->fd,
+                      (off_t)mr->offset);
+    if (view == MAP_FAILED) {
+        mr->errnum = errno;
+        mr->error = "mmap failed";
+        return -1;
+    }
+
+    /* the hints are advisory, so failures are ignored */
+    madvise(view, size, MADV_SEQUENTIAL);
+    madvise(view, size, MADV_WILLNEED);
+    mr->view = view;
+    return 0;
+}
+
+static void mmap_reader_close(struct mmap_reader_t *mr)
+{
+    mmap_reader_unmap(mr);
+    if (mr->fd >= 0)
+        close(mr->fd);
+}
+
+#endif  /* _WIN32 */
+
+static int mmap_reader_read(void *data, ro_seg_t *seg)
+{
+    struct mmap_reader_t *mr = (struct mmap_reader_t *)data;
+    size_t size;
+
+    /* the previous window is no longer referenced by the caller */
+    mmap_reader_unmap(mr);
+    if (mr->offset >= mr->file_size)
+        return 0;
+
+    size = mr->window;
+    if ((uint64_t)size > mr->file_size - mr->offset)
+        size = (size_t)(mr->file_size - mr->offset);
+
+    if (mmap_reader_map(mr, size) < 0)
+        return -1;
+
+    mr->view_size = size;
+    mr->offset += size;
+    seg->start = (const char *)mr->view;
+    seg->size = size;
+    return (int)size;
+}
+
+static void mmap_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    struct mmap_reader_t *mr = (struct mmap_reader_t *)data;
+    *buf = mr->error;
+    *errnum = mr->errnum;
+}
+
+void po_mmap_reader_init(struct strrdr_t *reader, const char *path)
+{
+    struct mmap_reader_t *mr = (struct mmap_reader_t *)malloc(sizeof(struct mmap_reader_t));
+    assert(reader != NULL);
+    mr->path = dup_str(path);
+#ifdef _WIN32
+    mr->file = INVALID_HANDLE_VALUE;
+    mr->mapping = NULL;
+#else
+    mr->fd = -1;
+#endif
+    mr->errnum = 0;
+    mr->error = "";
+    mr->file_size = 0;
+    mr->offset = 0;
+    mr->window = 0;
+    mr->view = NULL;
+    mr->view_size = 0;
+    reader->data = mr;
+    reader->open = mmap_reader_open;
+    reader->read = mmap_reader_read;
+    reader->get_error = mmap_reader_get_error;
+}
+
+void po_mmap_reader_uninit(struct strrdr_t *reader)
+{
+    struct mmap_reader_t *mr = (struct mmap_reader_t *)reader->data;
+    mmap_reader_close(mr);
+    free(mr->path);
+    free(mr);
+}
+
+/* writers */
+
+int strwtr_open(struct strwtr_t *writer)
+{
+    return writer->open(writer->data);
+}
+
+int strwtr_write(struct strwtr_t *writer, const ro_seg_t *seg)
+{
+    return writer->write(writer->data, seg);
+}
+
+int strwtr_flush(struct strwtr_t *writer)
+{
+    return writer->flush(writer->data);
+}
+
+void strwtr_get_error(struct strwtr_t *writer, const char **error, int *errnum)
+{
+    writer->get_error(writer->data, error, errnum);
+}
+
+/* file writer */
+
+#define FILE_WRITER_BUFLEN (64 * 1024)
+
+struct file_writer_t
+{
+    char *path;
+#ifdef _WIN32
+    FILE *fp;
+#else
+    int fd;
+#endif
+    int errnum;
+    const char *error;
+    char *buf;
+    size_t buflen;
+    size_t used;
+};
+
+#ifdef _WIN32
+
+static int file_writer_open(void *data)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)data;
+    fw->fp = fopen(fw->path, "wb");
+    if (fw->fp == NULL) {
+        fw->errnum = GetLastError();
+        fw->error = "fopen failed";
+        return -1;
+    }
+    /* buffering is done by the writer */
+    setvbuf(fw->fp, NULL, _IONBF, 0);
+    return 0;
+}
+
+static int file_writer_gather(struct file_writer_t *fw,
+                              const ro_seg_t *segs,
+                              int num_segs)
+{
+    int i;
+    for (i = 0; i < num_segs; ++i) {
+        if (fwrite(segs[i].start, 1, segs[i].size, fw->fp) != segs[i].size) {
+            fw->errnum = GetLastError();
+            fw->error = "fwrite failed";
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static void file_writer_close(struct file_writer_t *fw)
+{
+    if (fw->fp != NULL)
+        fclose(fw->fp);
+}
+
+#else  /* POSIX */
+
+#define FILE_WRITER_MAX_SEGS 2
+
+static int file_writer_open(void *data)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)data;
+    fw->fd = open(fw->path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fw->fd < 0) {
+        fw->errnum = errno;
+        fw->error = "open failed";
+        return -1;
+    }
+    return 0;
+}
+
+static int file_writer_gather(struct file_writer_t *fw,
+                              const ro_seg_t *segs,
+                              int num_segs)
+{
+    struct iovec iov[FILE_WRITER_MAX_SEGS];
+    int i, first = 0;
+
+    assert(num_segs <= FILE_WRITER_MAX_SEGS);
+    for (i = 0; i < num_segs; ++i) {
+        iov[i].iov_base = (void *)segs[i].start;
+        iov[i].iov_len = segs[i].size;
+    }
+
+    while (first < num_segs) {
+        ssize_t ret = writev(fw->fd, iov + first, num_segs - first);
+        if (ret < 0) {
+            if (errno == EINTR)
+                continue;
+            fw->errnum = errno;
+            fw->error = "writev failed";
+            return -1;
+        }
+
+        /* skip what was written, in case of a short write */
+        while (first < num_segs && (size_t)ret >= iov[first].iov_len)
+            ret -= (ssize_t)iov[first++].iov_len;
+        if (first < num_segs) {
+            iov[first].iov_base = (char *)iov[first].iov_base + ret;
+            iov[first].iov_len -= (size_t)ret;
+        }
+    }
+    return 0;
+}
+
+static void file_writer_close(struct file_writer_t *fw)
+{
+    if (fw->fd >= 0)
+        close(fw->fd);
+}
+
+#endif  /* _WIN32 */
+
+static int file_writer_write(void *data, const ro_seg_t *seg)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)data;
+    ro_seg_t segs[2];
+
+    if (seg->size <= fw->buflen - fw->used) {
+        memcpy(fw->buf + fw->used, seg->start, seg->size);
+        fw->used += seg->size;
+        return 0;
+    }
+
+    segs[0].start = fw->buf;
+    segs[0].size = fw->used;
+    ro_seg_assign(&segs[1], seg);
+    fw->used = 0;
+    return file_writer_gather(fw, segs, 2);
+}
+
+static int file_writer_flush(void *data)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)data;
+    ro_seg_t seg;
+
+    if (fw->used == 0)
+        return 0;
+    seg.start = fw->buf;
+    seg.size = fw->used;
+    fw->used = 0;
+    return file_writer_gather(fw, &seg, 1);
+}
+
+static void file_writer_get_error(void *data, const char **buf, int *errnum)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)data;
+    *buf = fw->error;
+    *errnum = fw->errnum;
+}
+
+void po_file_writer_init(struct strwtr_t *writer, const char *path)
+{
+    po_file_writer_init_buflen(writer, path, FILE_WRITER_BUFLEN);
+}
+
+void po_file_writer_init_buflen(struct strwtr_t *writer,
+                                const char *path,
+                                size_t buflen)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)malloc(sizeof(struct file_writer_t));
+    assert(writer != NULL);
+    assert(buflen > 0);
+    fw->path = dup_str(path);
+#ifdef _WIN32
+    fw->fp = NULL;
+#else
+    fw->fd = -1;
+#endif
+    fw->errnum = 0;
+    fw->error = "";
+    fw->buf = (char *)malloc(buflen);
+    fw->buflen = buflen;
+    fw->used = 0;
+    writer->data = fw;
+    writer->open = file_writer_open;
+    writer->write = file_writer_write;
+    writer->flush = file_writer_flush;
+    writer->get_error = file_writer_get_error;
+}
+
+void po_file_writer_uninit(struct strwtr_t *writer)
+{
+    struct file_writer_t *fw = (struct file_writer_t *)writer->data;
+#ifdef _WIN32
+    if (fw->fp != NULL)
+#else
+    if (fw->fd >= 0)
+#endif
+        file_writer_flush(fw);
+    file_writer_close(fw);
+    free(fw->buf);
+    free(fw->path);
+    free(fw);
+}
+
+/* memory reader */
+
+struct memory_reader_t
+{
+    ro_seg_t *segs;
+    size_t num_segs;
+    size_t segment_size;
+    size_t cur;     /* segs[cur] is being read */
+    size_t offset;  /* within segs[cur] */
+};
+
+static int memory_reader_open(void *data)
+{
+    (void)data;
+    return 0;
+}
+
+static int memory_reader_read(void *data, ro_seg_t *seg)
+{
+    struct memory_reader_t *mr = (struct memory_reader_t *)data;
+    size_t size;
+
+    while (mr->cur < mr->num_segs && mr->offset == mr->segs[mr->cur].size) {
+        ++mr->cur;
+        mr->offset = 0;
+    }
+    if (mr->cur == mr->num_segs)
+        return 0;
+
+    /* segments never span two buffers, so they can point into them */
+    size = mr->segs[mr->cur].size - mr->offset;
+    if (size > mr->segment_size)
+        size = mr->segment_size;
+    seg->start = mr->segs[mr->cur].start + mr->offset;
+    seg->size = size;
+    mr->offset += size;
+    return (int)size;
+}
+
+static void memory_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    (void)data;
+    *buf = "";
+    *errnum = 0;
+}
+
+void po_memory_reader_init(struct strrdr_t *reader,
+                           const char *start,
+                           size_t size,
+                           size_t segment_size)
+{
+    ro_seg_t seg;
+    seg.start = start;
+    seg.size = size;
+    po_memory_reader_init_scatter(reader, &seg, 1, segment_size);
+}
+
+void po_memory_reader_init_scatter(struct strrdr_t *reader,
+                                   const ro_seg_t *segs,
+                                   size_t num_segs,
+                                   size_t segment_size)
+{
+    struct memory_reader_t *mr = (struct memory_reader_t *)malloc(sizeof(struct memory_reader_t));
+    assert(reader != NULL);
+    mr->segs = (ro_seg_t *)malloc((num_segs > 0 ? num_segs : 1) * sizeof(ro_seg_t));
+    memcpy(mr->segs, segs, num_segs * sizeof(ro_seg_t));
+    mr->num_segs = num_segs;
+    mr->segment_size = segment_size == 0 || segment_size > INT_MAX
+        ? INT_MAX : segment_size;
+    mr->cur = 0;
+    mr->offset = 0;
+    reader->data = mr;
+    reader->open = memory_reader_open;
+    reader->read = memory_reader_read;
+    reader->get_error = memory_reader_get_error;
+}
+
+void po_memory_reader_uninit(struct strrdr_t *reader)
+{
+    struct memory_reader_t *mr = (struct memory_reader_t *)reader->data;
+    free(mr->segs);
+    free(mr);
+}
+
 /* line reader */
 
+/* Lines that lie entirely within one source chunk are returned in place,
+ * pointing into the source reader's buffer.  Only a line that straddles
+ * chunks is staged in cb. */
 struct line_reader_t
 {
     struct strrdr_t *src_reader;
     struct char_buffer_t cb;
+    ro_seg_t src;  /* not yet consumed part of the current source chunk */
     size_t bytes_returned;
     int at_eof;
 };
@@ -125,33 +880,43 @@ static int line_reader_open(void *data)
     return strrdr_open(ln->src_reader);
 }
 
-static int line_reader_drain_buffer(struct line_reader_t *ln, ro_seg_t *seg)
+static void line_reader_return_buffer(struct line_reader_t *ln, ro_seg_t *seg)
 {
-    const char *ptr, *end;
     seg_t chunk;
-    int ret = 0;
     char_buffer_get(&ln->cb, &chunk);
-    seg_get_start_and_end(&chunk, &ptr, &end);
-
-    while (ptr < end) {
-        if (*ptr == '\n') {
-            ++ptr;
-            seg->start = chunk.start;
-            seg->size = ln->bytes_returned = ptr - chunk.start;
-            ret = 1;
-            goto done;
-        }
-        ++ptr;
+    ro_seg_from_seg(seg, &chunk);
+    ln->bytes_returned = chunk.size;
+}
+
+static int line_reader_drain_src(struct line_reader_t *ln, ro_seg_t *seg)
+{
+    ro_seg_t line;
+    size_t pos = ro_seg_find_byte(&ln->src, '\n');
+    if (pos == ln->src.size) {
+        char_buffer_append_ro_seg(&ln->cb, &ln->src);
+        ln->src.size = 0;
+        return 0;
     }
 
-done:
-    return ret;
+    line.start = ln->src.start;
+    line.size = pos + 1;
+    ln->src.start += line.size;
+    ln->src.size -= line.size;
+
+    if (char_buffer_size(&ln->cb) == 0) {
+        ro_seg_assign(seg, &line);
+        return 1;
+    }
+
+    /* complete the line which started in a previous chunk */
+    char_buffer_append_ro_seg(&ln->cb, &line);
+    line_reader_return_buffer(ln, seg);
+    return 1;
 }
 
 static int line_reader_read(void *data, ro_seg_t *seg)
 {
     struct line_reader_t *ln = (struct line_reader_t *)data;
-    seg_t chunk;
     int ret;
 
     if (ln->at_eof)
@@ -160,36 +925,52 @@ static int line_reader_read(void *data, ro_seg_t *seg)
     char_buffer_pop_front(&ln->cb, ln->bytes_returned);
     ln->bytes_returned = 0;
 
-    if (line_reader_drain_buffer(ln, seg)) {
-        ret = (int)ln->bytes_returned;
-        goto done;
-    }
-
     while (1) {
-        ro_seg_t src;
-        ret = strrdr_read(ln->src_reader, &src);
+        if (ln->src.size > 0 && line_reader_drain_src(ln, seg))
+            return (int)seg->size;
+
+        ret = strrdr_read(ln->src_reader, &ln->src);
         if (ret == 0) {
             /* EOF: return whatever is inside the buffer */
             ln->at_eof = 1;
-            char_buffer_get(&ln->cb, &chunk);
-            ro_seg_from_seg(seg, &chunk);
-            ret = (int)chunk.size;
-            goto done;
+            ln->src.size = 0;
+            line_reader_return_buffer(ln, seg);
+            return (int)seg->size;
         }
         else if (ret < 0) {
-            goto done;  /* return ret */
+            ln->src.size = 0;
+            return ret;
         }
+    }
+}
 
-        char_buffer_append_ro_seg(&ln->cb, &src);
+int po_line_reader_read_batch(struct strrdr_t *reader,
+                              ro_seg_t *lines,
+                              size_t max_lines)
+{
+    struct line_reader_t *ln = (struct line_reader_t *)reader->data;
+    size_t n = 1;
+    int ret;
 
-        if (line_reader_drain_buffer(ln, seg)) {
-            ret = (int)ln->bytes_returned;
-            goto done;
-        }
+    assert(max_lines > 0);
+    ret = line_reader_read(ln, &lines[0]);
+    if (ret <= 0)
+        return ret;
+
+    /* the rest of the block is still valid, so its complete lines can be
+     * returned in place; a partial tail stays for the next call */
+    while (n < max_lines && ln->src.size > 0) {
+        size_t pos = ro_seg_find_byte(&ln->src, '\n');
+        if (pos == ln->src.size)
+            break;
+        lines[n].start = ln->src.start;
+        lines[n].size = pos + 1;
+        ln->src.start += pos + 1;
+        ln->src.size -= pos + 1;
+        ++n;
     }
 
-done:
-    return ret;
+    return (int)n;
 }
 
 static void line_reader_get_error(void *data, const char **buf, int *errnum)
@@ -204,6 +985,8 @@ void po_line_reader_init(struct strrdr_t *reader, struct strrdr_t *src_reader)
     char_buffer_init(&ln->cb);
     ln->bytes_returned = 0;
     ln->src_reader = src_reader;
+    ln->src.start = NULL;
+    ln->src.size = 0;
     ln->at_eof = 0;
     reader->data = ln;
     reader->open = line_reader_open;
@@ -18,6 +18,7 @@
 #define IO_H
 
 #include "str.h"
+#include "types.h"
 
 struct strrdr_t
 {
@@ -30,11 +31,87 @@ struct strrdr_t
 int strrdr_open(struct strrdr_t *reader);
 int strrdr_read(struct strrdr_t *reader, ro_seg_t *seg);
 void strrdr_get_error(struct strrdr_t *reader, const char **error, int *errnum);
+/* Counts the newlines (as wc -l does) in everything left in an opened reader.
+ * Returns 0, or the reader's negative error. */
+int strrdr_count_lines(struct strrdr_t *reader, uint64_t *lines);
 
+/* strwtr_t mirrors strrdr_t for output.  write and flush return 0, or a
+ * negative value on error, in which case get_error has the details.  A write
+ * may be buffered until the next flush; uninitializing a writer flushes it,
+ * but then errors go unreported. */
+struct strwtr_t
+{
+    int (* open)(void *);
+    int (* write)(void *, const ro_seg_t *);
+    int (* flush)(void *);
+    void (* get_error)(void *, const char **, int *);
+    void *data;
+};
+
+int strwtr_open(struct strwtr_t *writer);
+int strwtr_write(struct strwtr_t *writer, const ro_seg_t *seg);
+int strwtr_flush(struct strwtr_t *writer);
+void strwtr_get_error(struct strwtr_t *writer, const char **error, int *errnum);
+
+/* file writer: creates or truncates the file and gathers small writes in a
+ * buffer of buflen bytes; a write which does not fit goes out together with
+ * the buffer in a single writev, without being copied */
+void po_file_writer_init(struct strwtr_t *writer, const char *path);
+void po_file_writer_init_buflen(struct strwtr_t *writer,
+                                const char *path,
+                                size_t buflen);
+void po_file_writer_uninit(struct strwtr_t *writer);
+
+/* file reader: copies the file through a buffer of buflen bytes; the plain
+ * init uses a 64 KB buffer */
 void po_file_reader_init(struct strrdr_t *reader, const char *path);
+void po_file_reader_init_buflen(struct strrdr_t *reader,
+                                const char *path,
+                                size_t buflen);
+/* reads only the [begin, end) byte range of the file */
+void po_file_reader_init_range(struct strrdr_t *reader,
+                               const char *path,
+                               uint64_t begin,
+                               uint64_t end,
+                               size_t buflen);
 void po_file_reader_uninit(struct strrdr_t *reader);
 
+/* Splits a file into n ranges of about equal size, each starting right after
+ * a newline (or at offset 0), for processing in parallel.  Range i is
+ * [bounds[i], bounds[i+1]), so bounds must hold n + 1 offsets; a range can be
+ * empty when a single line spans several of them.  Each worker can read its
+ * range with po_file_reader_init_range() and a line reader on top.  Returns 0,
+ * or -1 with errnum set. */
+int file_split_lines(const char *path,
+                     uint64_t *bounds,
+                     size_t n,
+                     int *errnum);
+
+/* mmap reader: maps the file a window at a time and returns segments pointing
+ * straight into the mapping; a segment stays valid until the next read */
+void po_mmap_reader_init(struct strrdr_t *reader, const char *path);
+void po_mmap_reader_uninit(struct strrdr_t *reader);
+
+/* memory reader: returns segments of at most segment_size bytes (0 for no
+ * limit) which point into the caller's buffers; the buffers must outlive the
+ * reader, while the scatter list itself is copied */
+void po_memory_reader_init(struct strrdr_t *reader,
+                           const char *start,
+                           size_t size,
+                           size_t segment_size);
+void po_memory_reader_init_scatter(struct strrdr_t *reader,
+                                   const ro_seg_t *segs,
+                                   size_t num_segs,
+                                   size_t segment_size);
+void po_memory_reader_uninit(struct strrdr_t *reader);
+
 void po_line_reader_init(struct strrdr_t *reader, struct strrdr_t *src_reader);
 void po_line_reader_uninit(struct strrdr_t *reader);
+/* Fills lines with up to max_lines lines from the current source block and
+ * returns their number, 0 on EOF or a negative value on error.  The segments
+ * stay valid until the next read. */
+int po_line_reader_read_batch(struct strrdr_t *reader,
+                              ro_seg_t *lines,
+                              size_t max_lines);
 
 #endif  /* IO_H */
@@ -1,4 +1,6 @@
 #include "json.h"
+#include "scan.h"
+#include "utf8.h"
 #include <string.h>
 #include <assert.h>
 #include <stdio.h>
@@ -15,9 +17,16 @@ void json_string_init(json_string_t *jstr)
 {
     jstr->escape_seq_len = 0;
     jstr->unicode_escaped_value = 0;
+    jstr->validate_utf8 = 0;
+    utf8_state_init(&jstr->utf8);
     char_buffer_init(&jstr->output);
 }
 
+void json_string_set_validate_utf8(json_string_t *jstr, int enable)
+{
+    jstr->validate_utf8 = enable;
+}
+
 void json_string_uninit(json_string_t *jstr)
 {
     char_buffer_uninit(&jstr->output);
@@ -26,27 +35,28 @@ void json_string_uninit(json_string_t *jstr)
 static void append_uint16_as_utf8(struct char_buffer_t *output, uint16_t in)
 {
     uint8_t c;
+    /* at most three bytes are appended */
+    char_buffer_reserve(output, 3);
     if (in <= 0x007f) {
         c = (char)in;
-        /* TODO: add efficient add char function */
-        char_buffer_append(output, (char *)&c, 1);
+        char_buffer_push_char_unchecked(output, (char)c);
     }
     else if (in <= 0x07ff) {
         /* codes that require two bytes to store */
         c = ((uint8_t)(in >> 6)) | 0xc0;
-        char_buffer_append(output, (char *)&c, 1);
+        char_buffer_push_char_unchecked(output, (char)c);
         c = ((uint8_t)(in & 0x003f)) | 0x80;
-        char_buffer_append(output, (char *)&c, 1);
+        char_buffer_push_char_unchecked(output, (char)c);
     }
     else {
         assert(in >= 0x0800);
         /* codes that require three bytes to store */
         c = ((uint8_t)(in >> 12)) | 0xe0;
-        char_buffer_append(output, (char *)&c, 1);
+        char_buffer_push_char_unchecked(output, (char)c);
         c = ((uint8_t)(in >> 6) & 0x3f) | 0x80;
-        char_buffer_append(output, (char *)&c, 1);
+        char_buffer_push_char_unchecked(output, (char)c);
         c = ((uint8_t)(in & 0x3f)) | 0x80;
-        char_buffer_append(output, (char *)&c, 1);
+        char_buffer_push_char_unchecked(output, (char)c);
     }
 }
 
@@ -67,27 +77,30 @@ enum json_code_t json_string_parse(json_string_t *jstr, ro_seg_t *next_chunk)
 parse:
     /* this section handles the unescaped input */
     {
-        const char *cur, *end;
-        size_t len;
-        ro_seg_get_start_and_end(next_chunk, &cur, &end);
-        assert(cur < end);
+        static const char special_chars[] = { '"', '\\' };
+        const size_t len = ro_seg_find_first_of(next_chunk, special_chars,
+                                                sizeof(special_chars));
+        assert(next_chunk->size > 0);
 
-        do {
-            if (*cur == '"')
-                break;
-            else if (*cur == '\\') {
-                if (cur > next_chunk->start) {
-                    const size_t len = cur - next_chunk->start;
-                    char_buffer_append(output, next_chunk->start, len);
-                    ro_seg_trim_front(next_chunk, len);
-                }
-                goto escape_seq;
+        if (len > 0) {
+            if (jstr->validate_utf8) {
+                ro_seg_t run;
+                run.start = next_chunk->start;
+                run.size = len;
+                if (utf8_validate(&jstr->utf8, &run))
+                    return JSON_INPUT_ERROR;
             }
-        } while (++cur < end);
-
-        len = cur - next_chunk->start;
-        char_buffer_append(output, next_chunk->start, len);
-        ro_seg_trim_front(next_chunk, len);
+            char_buffer_append(output, next_chunk->start, len);
+            ro_seg_trim_front(next_chunk, len);
+        }
+        if (next_chunk->size > 0) {
+            /* an escape sequence or the closing double-quote must not cut
+             * a multi-byte UTF-8 sequence short */
+            if (jstr->validate_utf8 && !utf8_state_is_complete(&jstr->utf8))
+                return JSON_INPUT_ERROR;
+            if (next_chunk->start[0] == '\\')
+                goto escape_seq;
+        }
         return JSON_READY;
     }
 
@@ -120,8 +133,7 @@ escape_seq:
     }
 
     ro_seg_trim_front(next_chunk, 1);
-    /* TODO: make a fast "append char" function */
-    char_buffer_append(output, &c, 1);
+    char_buffer_push_char(output, c);
     jstr->escape_seq_len = 0;
     jstr->unicode_escaped_value = 0;
 
@@ -224,7 +236,7 @@ at_NUM_STATE_INIT:
         assert(jnum->type == JSON_INTEGER);
         switch (*next_chunk->start) {
         case '0':
-            char_buffer_append(&jnum->buffer, next_chunk->start, 1);
+            char_buffer_push_char(&jnum->buffer, *next_chunk->start);
             ro_seg_trim_front(next_chunk, 1);
             jnum->state = NUM_STATE_GOT_ZERO;
             if (next_chunk->size == 0) {
@@ -235,7 +247,7 @@ at_NUM_STATE_INIT:
         case '-':
             assert(jnum->int_negative == 0);
             jnum->int_negative = 1;
-            char_buffer_append(&jnum->buffer, next_chunk->start, 1);
+            char_buffer_push_char(&jnum->buffer, *next_chunk->start);
             ro_seg_trim_front(next_chunk, 1);
             jnum->state = NUM_STATE_GOT_NEGATIVE;
             if (next_chunk->size == 0) {
@@ -247,7 +259,7 @@ at_NUM_STATE_INIT:
             if (IS_NONZERO_DIGIT(*next_chunk->start)) {
                 assert(jnum->type == JSON_INTEGER);
                 jnum->int_value = (int64_t)(*next_chunk->start - '0');
-                char_buffer_append(&jnum->buffer, next_chunk->start, 1);
+                char_buffer_push_char(&jnum->buffer, *next_chunk->start);
                 ro_seg_trim_front(next_chunk, 1);
                 jnum->state = NUM_STATE_GOT_NONZERO;
                 if (next_chunk->size == 0) {
@@ -264,7 +276,7 @@ at_NUM_STATE_GOT_NEGATIVE:
         assert(next_chunk->size > 0);
         switch (*next_chunk->start) {
         case '0':
-            char_buffer_append(&jnum->buffer, next_chunk->start, 1);
+            char_buffer_push_char(&jnum->buffer, *next_chunk->start);
             ro_seg_trim_front(next_chunk, 1);
             jnum->state = NUM_STATE_GOT_ZERO;
             if (next_chunk->size == 0) {
@@ -276,7 +288,7 @@ at_NUM_STATE_GOT_NEGATIVE:
             if (IS_NONZERO_DIGIT(*next_chunk->start)) {
                 assert(jnum->type == JSON_INTEGER);
                 jnum->int_value += (int64_t)(*next_chunk->start - '0');
-                char_buffer_append(&jnum->buffer, next_chunk->start, 1);
+                char_buffer_push_char(&jnum->buffer, *next_chunk->start);
                 ro_seg_trim_front(next_chunk, 1);
                 jnum->state = NUM_STATE_GOT_NONZERO;
                 if (next_chunk->size == 0) {
@@ -339,7 +351,7 @@ at_NUM_STATE_GOT_NONZERO:
                  * into a floating point number */
                 assert(jnum->type == JSON_INTEGER);
                 jnum->type = JSON_FLOATING;
-                char_buffer_append(&jnum->buffer, ".", 1);
+                char_buffer_push_char(&jnum->buffer, '.');
                 ro_seg_trim_front(next_chunk, 1);
                 jnum->state = NUM_STATE_GOT_SEPARATOR;
                 if (next_chunk->size == 0) {
@@ -351,7 +363,7 @@ at_NUM_STATE_GOT_NONZERO:
             case 'e':
                 assert(jnum->type == JSON_INTEGER);
                 jnum->type = JSON_FLOATING;
-                char_buffer_append(&jnum->buffer, "e", 1);
+                char_buffer_push_char(&jnum->buffer, 'e');
                 ro_seg_trim_front(next_chunk, 1);
                 jnum->state = NUM_STATE_GOT_EXPONENT;
                 if (next_chunk->size == 0) {
@@ -373,7 +385,7 @@ at_NUM_STATE_GOT_ZERO:
              * into a floating point number */
             assert(jnum->type == JSON_INTEGER);
             jnum->type = JSON_FLOATING;
-            char_buffer_append(&jnum->buffer, ".", 1);
+            char_buffer_push_char(&jnum->buffer, '.');
             ro_seg_trim_front(next_chunk, 1);
             jnum->state = NUM_STATE_GOT_SEPARATOR;
             if (next_chunk->size == 0) {
@@ -385,7 +397,7 @@ at_NUM_STATE_GOT_ZERO:
         case 'e':
             assert(jnum->type == JSON_INTEGER);
             jnum->type = JSON_FLOATING;
-            char_buffer_append(&jnum->buffer, "e", 1);
+            char_buffer_push_char(&jnum->buffer, 'e');
             ro_seg_trim_front(next_chunk, 1);
             jnum->state = NUM_STATE_GOT_EXPONENT;
             if (next_chunk->size == 0) {
@@ -404,7 +416,7 @@ at_NUM_STATE_GOT_SEPARATOR:
         assert(next_chunk->size > 0);
         if (!IS_DIGIT(*next_chunk->start))
             goto input_error;
-        char_buffer_append(&jnum->buffer, next_chunk->start, 1);
+        char_buffer_push_char(&jnum->buffer, *next_chunk->start);
         ro_seg_trim_front(next_chunk, 1);
         jnum->state = NUM_STATE_GOT_FRACTION_DIGIT;
         if (next_chunk->size == 0) {
@@ -416,21 +428,18 @@ at_NUM_STATE_GOT_SEPARATOR:
 at_NUM_STATE_GOT_FRACTION_DIGIT:
     case NUM_STATE_GOT_FRACTION_DIGIT:
         {
-            char *cur, *end;
+            size_t len;
             assert(next_chunk->size > 0);
             assert(char_buffer_size(&jnum->buffer) > 0);
-            ro_seg_get_start_and_end(next_chunk, &cur, &end);
-            while (cur < end && IS_DIGIT(*cur))
-                ++cur;
-            if (cur > next_chunk->start) {
-                const size_t len = cur - next_chunk->start;
+            len = ro_seg_find_non_digit(next_chunk);
+            if (len > 0) {
                 char_buffer_append(&jnum->buffer, next_chunk->start, len);
                 ro_seg_trim_front(next_chunk, len);
             }
             if (next_chunk->size > 0 && IS_EXPONENT(next_chunk->start[0])) {
                 /* 'E' or 'e' found after the digit */
                 assert(jnum->type == JSON_FLOATING);
-                char_buffer_append(&jnum->buffer, "e", 1);
+                char_buffer_push_char(&jnum->buffer, 'e');
                 ro_seg_trim_front(next_chunk, 1);
                 jnum->state = NUM_STATE_GOT_EXPONENT;
                 if (next_chunk->size == 0) {
@@ -452,7 +461,7 @@ at_NUM_STATE_GOT_EXPONENT:
             switch (c) {
             case '+':
             case '-':
-                char_buffer_append(&jnum->buffer, &c, 1);
+                char_buffer_push_char(&jnum->buffer, c);
                 ro_seg_trim_front(next_chunk, 1);
                 jnum->state = NUM_STATE_GOT_EXP_SIGN;
                 if (next_chunk->size == 0) {
@@ -466,7 +475,7 @@ at_NUM_STATE_GOT_EXPONENT:
                     goto input_error;
             }
 
-            char_buffer_append(&jnum->buffer, &c, 1);
+            char_buffer_push_char(&jnum->buffer, c);
             ro_seg_trim_front(next_chunk, 1);
             jnum->state = NUM_STATE_GOT_EXP_DIGIT;
             if (next_chunk->size == 0) {
@@ -488,14 +497,11 @@ at_NUM_STATE_GOT_EXP_SIGN:
 at_NUM_STATE_GOT_EXP_DIGIT:
     case NUM_STATE_GOT_EXP_DIGIT:
         {
-            char *cur, *end;
+            size_t len;
             assert(next_chunk->size > 0);
             assert(char_buffer_size(&jnum->buffer) > 0);
-            ro_seg_get_start_and_end(next_chunk, &cur, &end);
-            while (cur < end && IS_DIGIT(*cur))
-                ++cur;
-            if (cur > next_chunk->start) {
-                const size_t len = cur - next_chunk->start;
+            len = ro_seg_find_non_digit(next_chunk);
+            if (len > 0) {
                 char_buffer_append(&jnum->buffer, next_chunk->start, len);
                 ro_seg_trim_front(next_chunk, len);
             }
@@ -555,6 +561,12 @@ void json_value_init(json_value_t *jval)
 {
     jval->type = JSON_NO_VALUE;
     jval->state = 0;
+    jval->validate_utf8 = 0;
+}
+
+void json_value_set_validate_utf8(json_value_t *jval, int enable)
+{
+    jval->validate_utf8 = enable;
 }
 
 void json_value_uninit(json_value_t *jval)
@@ -594,6 +606,7 @@ at_VAL_STATE_INIT:
         if (IS_FIRST_STRING_CHAR(c)) {
             jval->type = JSON_STRING;
             json_string_init(&jval->value.str);
+            json_string_set_validate_utf8(&jval->value.str, jval->validate_utf8);
             /* strip the leading double-quote as json_string_* does not
              * consume those, but only the string contents within the
              * double-quotes */
@@ -19,6 +19,7 @@
 
 #include "str.h"
 #include "types.h"
+#include "utf8.h"
 
 enum json_code_t { JSON_READY, JSON_NEED_MORE, JSON_INPUT_ERROR };
 
@@ -30,9 +31,13 @@ typedef struct _json_string_t
     /* during unicode escaping (\uxxxx) stores the current incarnation of the
      * final value */
     uint16_t unicode_escaped_value;
+    /* when set, the unescaped input is validated as UTF-8 while parsing */
+    int validate_utf8;
+    struct utf8_state_t utf8;
 } json_string_t;
 
 void json_string_init(json_string_t *jstr);
+void json_string_set_validate_utf8(json_string_t *jstr, int enable);
 void json_string_uninit(json_string_t *jstr);
 enum json_code_t json_string_parse(json_string_t *jstr, ro_seg_t *next_chunk);
 /* TODO: make result const */
@@ -87,9 +92,11 @@ typedef struct _json_value_t
     unsigned state;
     const char *literal;
     const char *literal_ptr;
+    int validate_utf8;  /* passed on to json_string_t */
 } json_value_t;
 
 void json_value_init(json_value_t *jval);
+void json_value_set_validate_utf8(json_value_t *jval, int enable);
 void json_value_uninit(json_value_t *jval);
 enum json_code_t json_value_parse(json_value_t *jval, ro_seg_t *next_chunk);
 /* TODO: make result const */
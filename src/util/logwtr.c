@@ -0,0 +1,335 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "logwtr.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include <errno.h>
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+
+static int log_writer_open_file(struct log_writer_t *lw)
+{
+    lw->fp = fopen(lw->path, "ab");
+    if (lw->fp == NULL) {
+        lw->errnum = GetLastError();
+        lw->error = "fopen failed";
+        return -1;
+    }
+    setvbuf(lw->fp, NULL, _IONBF, 0);
+    return 0;
+}
+
+static int log_writer_write_and_sync(struct log_writer_t *lw, const seg_t *seg)
+{
+    if (fwrite(seg->start, 1, seg->size, lw->fp) != seg->size) {
+        lw->errnum = GetLastError();
+        lw->error = "fwrite failed";
+        return -1;
+    }
+    if (_commit(_fileno(lw->fp)) != 0) {
+        lw->errnum = errno;
+        lw->error = "_commit failed";
+        return -1;
+    }
+    return 0;
+}
+
+static void log_writer_close_file(struct log_writer_t *lw)
+{
+    if (lw->fp != NULL)
+        fclose(lw->fp);
+}
+
+#else  /* POSIX */
+
+static int log_writer_open_file(struct log_writer_t *lw)
+{
+    lw->fd = open(lw->path, O_WRONLY | O_CREAT | O_APPEND, 0666);
+    if (lw->fd < 0) {
+        lw->errnum = errno;
+        lw->error = "open failed";
+        return -1;
+    }
+    return 0;
+}
+
+static int log_writer_write_and_sync(struct log_writer_t *lw, const seg_t *seg)
+{
+    const char *start = seg->start;
+    size_t left = seg->size;
+    int ret;
+
+    while (left > 0) {
+        const ssize_t written = write(lw->fd, start, left);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            lw->errnum = errno;
+            lw->error = "write failed";
+            return -1;
+        }
+        start += written;
+        left -= (size_t)written;
+    }
+
+#ifdef __linux__
+    ret = fdatasync(lw->fd);
+#else
+    ret = fsync(lw->fd);
+#endif
+    if (ret != 0) {
+        lw->errnum = errno;
+        lw->error = "fsync failed";
+        return -1;
+    }
+    return 0;
+}
+
+static void log_writer_close_file(struct log_writer_t *lw)
+{
+    if (lw->fd >= 0)
+        close(lw->fd);
+}
+
+#endif  /* _WIN32 */
+
+static void log_writer_run(void *arg)
+{
+    struct log_writer_t *lw = (struct log_writer_t *)arg;
+
+    mutex_lock(&lw->mutex);
+    while (1) {
+        struct char_buffer_t *batch = &lw->bufs[lw->active];
+        uint64_t batch_seq;
+        seg_t seg;
+        int ret;
+
+        while (lw->durable_seq == lw->submitted_seq && !lw->stop)
+            cond_wait(&lw->work, &lw->mutex);
+        if (lw->durable_seq == lw->submitted_seq)
+            break;  /* stopped, and nothing is left */
+
+        /* producers fill the other buffer while this one is written */
+        lw->active ^= 1;
+        batch_seq = lw->submitted_seq;
+        mutex_unlock(&lw->mutex);
+
+        char_buffer_get(batch, &seg);
+        ret = log_writer_write_and_sync(lw, &seg);
+        char_buffer_clear(batch);
+
+        mutex_lock(&lw->mutex);
+        ++lw->syncs;
+        if (ret < 0)
+            lw->stop = 1;  /* the error stays in lw */
+        else
+            lw->durable_seq = batch_seq;
+        cond_broadcast(&lw->durable);
+        if (ret < 0)
+            break;
+    }
+    mutex_unlock(&lw->mutex);
+}
+
+void log_writer_init(struct log_writer_t *lw, const char *path)
+{
+    lw->path = dup_str(path);
+#ifdef _WIN32
+    lw->fp = NULL;
+#else
+    lw->fd = -1;
+#endif
+    mutex_init(&lw->mutex);
+    cond_init(&lw->work);
+    cond_init(&lw->durable);
+    char_buffer_init(&lw->bufs[0]);
+    char_buffer_init(&lw->bufs[1]);
+    lw->active = 0;
+    lw->submitted_seq = 0;
+    lw->durable_seq = 0;
+    lw->syncs = 0;
+    lw->stop = 0;
+    lw->errnum = 0;
+    lw->error = "";
+    lw->started = 0;
+}
+
+int log_writer_open(struct log_writer_t *lw)
+{
+    if (log_writer_open_file(lw) < 0)
+        return -1;
+    if (thread_create(&lw->thread, log_writer_run, lw) < 0) {
+        lw->error = "thread_create failed";
+        return -1;
+    }
+    lw->started = 1;
+    return 0;
+}
+
+void log_writer_uninit(struct log_writer_t *lw)
+{
+    if (lw->started) {
+        mutex_lock(&lw->mutex);
+        lw->stop = 1;
+        cond_signal(&lw->work);
+        mutex_unlock(&lw->mutex);
+        thread_join(&lw->thread);
+    }
+
+    log_writer_close_file(lw);
+    char_buffer_uninit(&lw->bufs[0]);
+    char_buffer_uninit(&lw->bufs[1]);
+    cond_uninit(&lw->durable);
+    cond_uninit(&lw->work);
+    mutex_uninit(&lw->mutex);
+    free(lw->path);
+}
+
+void log_writer_get_error(struct log_writer_t *lw,
+                          const char **error,
+                          int *errnum)
+{
+    mutex_lock(&lw->mutex);
+    *error = lw->error;
+    *errnum = lw->errnum;
+    mutex_unlock(&lw->mutex);
+}
+
+uint64_t log_writer_get_syncs(struct log_writer_t *lw)
+{
+    uint64_t syncs;
+    mutex_lock(&lw->mutex);
+    syncs = lw->syncs;
+    mutex_unlock(&lw->mutex);
+    return syncs;
+}
+
+int log_writer_submit(struct log_writer_t *lw,
+                      const ro_seg_t *seg,
+                      uint64_t *seq)
+{
+    int ret = 0;
+
+    mutex_lock(&lw->mutex);
+    if (lw->stop)
+        ret = -1;
+    else {
+        char_buffer_append_ro_seg(&lw->bufs[lw->active], seg);
+        *seq = ++lw->submitted_seq;
+        cond_signal(&lw->work);
+    }
+    mutex_unlock(&lw->mutex);
+    return ret;
+}
+
+int log_writer_wait(struct log_writer_t *lw, uint64_t seq)
+{
+    int ret = 0;
+
+    mutex_lock(&lw->mutex);
+    while (lw->durable_seq < seq && !lw->stop)
+        cond_wait(&lw->durable, &lw->mutex);
+    if (lw->durable_seq < seq)
+        ret = -1;
+    mutex_unlock(&lw->mutex);
+    return ret;
+}
+
+/* log stream */
+
+struct log_stream_t
+{
+    struct log_writer_t *lw;
+    struct char_buffer_t cb;
+    uint64_t last_seq;  /* of the stream's latest submission */
+};
+
+static int log_stream_open(void *data)
+{
+    (void)data;
+    return 0;
+}
+
+static int log_stream_submit(struct log_stream_t *ls)
+{
+    seg_t seg;
+    ro_seg_t roseg;
+
+    char_buffer_get(&ls->cb, &seg);
+    if (seg.size == 0)
+        return 0;
+
+    ro_seg_from_seg(&roseg, &seg);
+    if (log_writer_submit(ls->lw, &roseg, &ls->last_seq) < 0)
+        return -1;
+    char_buffer_clear(&ls->cb);
+    return 0;
+}
+
+static int log_stream_write(void *data, const ro_seg_t *seg)
+{
+    struct log_stream_t *ls = (struct log_stream_t *)data;
+    char_buffer_append_ro_seg(&ls->cb, seg);
+    if (char_buffer_size(&ls->cb) >= LOG_STREAM_BUFLEN)
+        return log_stream_submit(ls);
+    return 0;
+}
+
+static int log_stream_flush(void *data)
+{
+    struct log_stream_t *ls = (struct log_stream_t *)data;
+    if (log_stream_submit(ls) < 0)
+        return -1;
+    return log_writer_wait(ls->lw, ls->last_seq);
+}
+
+static void log_stream_get_error(void *data, const char **buf, int *errnum)
+{
+    struct log_stream_t *ls = (struct log_stream_t *)data;
+    log_writer_get_error(ls->lw, buf, errnum);
+}
+
+void po_log_stream_init(struct strwtr_t *writer, struct log_writer_t *lw)
+{
+    struct log_stream_t *ls = (struct log_stream_t *)malloc(sizeof(struct log_stream_t));
+    assert(writer != NULL);
+    ls->lw = lw;
+    char_buffer_init(&ls->cb);
+    ls->last_seq = 0;
+    writer->data = ls;
+    writer->open = log_stream_open;
+    writer->write = log_stream_write;
+    writer->flush = log_stream_flush;
+    writer->get_error = log_stream_get_error;
+}
+
+void po_log_stream_uninit(struct strwtr_t *writer)
+{
+    struct log_stream_t *ls = (struct log_stream_t *)writer->data;
+    /* records still buffered are submitted, but not waited for */
+    log_stream_submit(ls);
+    char_buffer_uninit(&ls->cb);
+    free(ls);
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LOGWTR_H
+#define LOGWTR_H
+
+#include "io.h"
+#include "thread.h"
+
+/* Group-commit log writer.  Producer threads append records to streams of
+ * their own (see po_log_stream_init) without taking any lock; a flush hands
+ * the stream's records to the log writer and waits until they are durable.
+ * A background thread writes everything submitted since its last round and
+ * syncs it with a single fsync, so concurrent flushes share one sync.
+ *
+ * Every submission gets a sequence number, and waiters are woken once the
+ * durable sequence number reaches theirs. */
+
+struct log_writer_t
+{
+    char *path;
+#ifdef _WIN32
+    FILE *fp;
+#else
+    int fd;
+#endif
+    mutex_t mutex;
+    cond_t work;     /* signaled on submissions */
+    cond_t durable;  /* broadcast after each sync */
+    struct char_buffer_t bufs[2];
+    int active;      /* bufs[active] collects submissions */
+    uint64_t submitted_seq;
+    uint64_t durable_seq;
+    uint64_t syncs;  /* for statistics */
+    int stop;
+    int errnum;
+    const char *error;
+    thread_t thread;
+    int started;
+};
+
+void log_writer_init(struct log_writer_t *lw, const char *path);
+/* opens (appending to) the file and starts the background thread; records
+ * submitted before are written together, in its first round */
+int log_writer_open(struct log_writer_t *lw);
+/* writes out whatever was submitted before stopping */
+void log_writer_uninit(struct log_writer_t *lw);
+void log_writer_get_error(struct log_writer_t *lw,
+                          const char **error,
+                          int *errnum);
+/* number of syncs so far, for statistics */
+uint64_t log_writer_get_syncs(struct log_writer_t *lw);
+
+/* both return 0, or -1 once the log writer has failed */
+int log_writer_submit(struct log_writer_t *lw,
+                      const ro_seg_t *seg,
+                      uint64_t *seq);
+int log_writer_wait(struct log_writer_t *lw, uint64_t seq);
+
+/* A stream is used by a single thread.  Writes are buffered in the stream,
+ * and handed to the log writer without waiting once the buffer grows past
+ * LOG_STREAM_BUFLEN; strwtr_flush() submits the rest and waits for all of
+ * the stream's records to become durable. */
+
+#define LOG_STREAM_BUFLEN (64 * 1024)
+
+void po_log_stream_init(struct strwtr_t *writer, struct log_writer_t *lw);
+void po_log_stream_uninit(struct strwtr_t *writer);
+
+#endif  /* LOGWTR_H */
@@ -0,0 +1,824 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "lz4.h"
+#include "hash.h"
+#include "str.h"
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <assert.h>
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5  /* a block always ends with literals */
+#define LZ4_MF_LIMIT 12      /* no match starts this close to the end */
+#define LZ4_MAX_OFFSET 65535
+#define LZ4_SKIP_TRIGGER 6   /* search faster after 2^6 misses in a row */
+#define LZ4_WINDOW (64 * 1024)
+
+#define LZ4_MAGIC 0x184d2204
+#define LZ4_SKIPPABLE_MAGIC 0x184d2a50  /* low 4 bits are free */
+#define LZ4_SKIPPABLE_MASK 0xfffffff0
+
+#define LZ4_FLG_VERSION 0x40
+#define LZ4_FLG_BLOCK_INDEP 0x20
+#define LZ4_FLG_BLOCK_CHECKSUM 0x10
+#define LZ4_FLG_CONTENT_SIZE 0x08
+#define LZ4_FLG_CONTENT_CHECKSUM 0x04
+#define LZ4_FLG_DICT_ID 0x01
+#define LZ4_BLOCK_UNCOMPRESSED 0x80000000
+
+static uint32_t read_le32(const char *p)
+{
+    const unsigned char *u = (const unsigned char *)p;
+    return (uint32_t)u[0] | ((uint32_t)u[1] << 8) |
+           ((uint32_t)u[2] << 16) | ((uint32_t)u[3] << 24);
+}
+
+static void write_le32(char *p, uint32_t val)
+{
+    p[0] = (char)(val & 0xff);
+    p[1] = (char)((val >> 8) & 0xff);
+    p[2] = (char)((val >> 16) & 0xff);
+    p[3] = (char)((val >> 24) & 0xff);
+}
+
+/* block codec */
+
+static uint32_t load32(const char *p)
+{
+    uint32_t val;
+    memcpy(&val, p, sizeof(val));
+    return val;
+}
+
+static uint32_t lz4_hash(uint32_t seq)
+{
+    return (seq * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+/* number of equal bytes at p and match, not going past limit */
+static size_t lz4_count(const char *p, const char *match, const char *limit)
+{
+    const char *const start = p;
+    uint64_t a, b;
+
+    while (p + 8 <= limit) {
+        memcpy(&a, p, 8);
+        memcpy(&b, match, 8);
+        if (a != b)
+            break;
+        p += 8;
+        match += 8;
+    }
+    while (p < limit && *p == *match) {
+        ++p;
+        ++match;
+    }
+    return (size_t)(p - start);
+}
+
+static char *lz4_put_length(char *op, size_t len)
+{
+    for (; len >= 255; len -= 255)
+        *op++ = (char)255;
+    *op++ = (char)len;
+    return op;
+}
+
+static char *lz4_put_literals(char *op,
+                              const char *literals,
+                              size_t len,
+                              unsigned match_code)
+{
+    char *const token = op++;
+    if (len >= 15) {
+        *token = (char)(0xf0 | match_code);
+        op = lz4_put_length(op, len - 15);
+    }
+    else
+        *token = (char)((len << 4) | match_code);
+    memcpy(op, literals, len);
+    return op + len;
+}
+
+size_t lz4_compress_bound(size_t size)
+{
+    return size + size / 255 + 16;
+}
+
+size_t lz4_compress(struct lz4_state_t *state,
+                    const ro_seg_t *src,
+                    char *dst)
+{
+    const char *const base = src->start;
+    const char *const end = base + src->size;
+    const char *const mf_limit = end - LZ4_MF_LIMIT;
+    const char *const match_limit = end - LZ4_LAST_LITERALS;
+    const char *anchor = base;
+    const char *ip = base;
+    char *op = dst;
+
+    assert(src->size <= UINT32_MAX);
+    if (src->size < LZ4_MF_LIMIT + 1)
+        return (size_t)(lz4_put_literals(op, anchor, src->size, 0) - dst);
+
+    memset(state->table, 0, sizeof(state->table));
+    ++ip;
+
+    for (;;) {
+        const char *match;
+        size_t len;
+        unsigned attempts = 1 << LZ4_SKIP_TRIGGER;
+
+        /* find a match, taking longer steps the longer there is none */
+        for (;;) {
+            const uint32_t h = lz4_hash(load32(ip));
+            const char *next = ip + (attempts++ >> LZ4_SKIP_TRIGGER);
+            match = base + state->table[h];
+            state->table[h] = (uint32_t)(ip - base);
+            if (ip - match <= LZ4_MAX_OFFSET && match < ip &&
+                load32(match) == load32(ip))
+                break;
+            if (next > mf_limit)
+                goto last_literals;
+            ip = next;
+        }
+
+        /* extend it backwards */
+        while (ip > anchor && match > base && ip[-1] == match[-1]) {
+            --ip;
+            --match;
+        }
+
+        len = lz4_count(ip + LZ4_MIN_MATCH, match + LZ4_MIN_MATCH,
+                        match_limit);
+        op = lz4_put_literals(op, anchor, (size_t)(ip - anchor),
+                              len >= 15 ? 15 : (unsigned)len);
+        op[0] = (char)((ip - match) & 0xff);
+        op[1] = (char)((ip - match) >> 8);
+        op += 2;
+        if (len >= 15)
+            op = lz4_put_length(op, len - 15);
+
+        ip += LZ4_MIN_MATCH + len;
+        anchor = ip;
+        if (ip > mf_limit)
+            break;
+        /* the end of a match is a likely start for the next one */
+        state->table[lz4_hash(load32(ip - 2))] = (uint32_t)(ip - 2 - base);
+    }
+
+last_literals:
+    op = lz4_put_literals(op, anchor, (size_t)(end - anchor), 0);
+    return (size_t)(op - dst);
+}
+
+/* reads the extra bytes of a length which starts at 15; returns -1 if they
+ * run past end or the length gets absurd */
+static int lz4_get_length(const unsigned char **ip,
+                          const unsigned char *end,
+                          size_t *len)
+{
+    unsigned b;
+    do {
+        if (*ip >= end)
+            return -1;
+        b = *(*ip)++;
+        *len += b;
+        if (*len > INT_MAX)
+            return -1;
+    } while (b == 255);
+    return 0;
+}
+
+/* dst is preceded by prefix_size bytes of earlier output which matches may
+ * refer to */
+static int lz4_decompress_prefix(const ro_seg_t *src,
+                                 char *dst,
+                                 size_t dst_size,
+                                 size_t prefix_size)
+{
+    const unsigned char *ip = (const unsigned char *)src->start;
+    const unsigned char *const end = ip + src->size;
+    char *op = dst;
+    char *const op_end = dst + dst_size;
+
+    for (;;) {
+        unsigned token;
+        size_t len, offset;
+        const char *match;
+
+        if (ip >= end)
+            return -1;
+        token = *ip++;
+
+        len = token >> 4;
+        if (len == 15 && lz4_get_length(&ip, end, &len) < 0)
+            return -1;
+        if (len > (size_t)(end - ip) || len > (size_t)(op_end - op))
+            return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == end)
+            break;  /* the last sequence has no match */
+
+        if (end - ip < 2)
+            return -1;
+        offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst) + prefix_size)
+            return -1;
+
+        len = token & 15;
+        if (len == 15 && lz4_get_length(&ip, end, &len) < 0)
+            return -1;
+        len += LZ4_MIN_MATCH;
+        if (len > (size_t)(op_end - op))
+            return -1;
+
+        match = op - offset;
+        if (offset >= len) {
+            memcpy(op, match, len);
+            op += len;
+        }
+        else {
+            /* overlapping, i.e. repeating the last offset bytes */
+            while (len--)
+                *op++ = *match++;
+        }
+    }
+    return (int)(op - dst);
+}
+
+int lz4_decompress(const ro_seg_t *src, char *dst, size_t dst_size)
+{
+    assert(dst_size <= INT_MAX);
+    return lz4_decompress_prefix(src, dst, dst_size, 0);
+}
+
+/* frame reader */
+
+struct lz4_reader_t
+{
+    struct strrdr_t *src_reader;
+    ro_seg_t in;
+    int src_eof;
+    struct char_buffer_t staged;  /* for data which spans source segments */
+
+    /* current frame */
+    int in_frame;
+    int linked;
+    int block_checksum;
+    int content_checksum;
+    int has_content_size;
+    uint64_t content_size;
+    uint64_t produced;
+    size_t block_max;
+    struct hash32_state_t checksum;
+
+    /* output; for linked blocks the LZ4_WINDOW bytes before out_pos stay
+     * around for back-references */
+    char *out;
+    size_t out_cap;
+    size_t out_pos;
+
+    int failed;
+    int src_failed;  /* the error comes from the source reader */
+    const char *error;
+};
+
+static int lz4_reader_fail(struct lz4_reader_t *lr, const char *error)
+{
+    lr->failed = 1;
+    lr->error = error;
+    return -1;
+}
+
+static int lz4_reader_pull(struct lz4_reader_t *lr)
+{
+    int ret;
+    if (lr->src_eof)
+        return 0;
+
+    ret = strrdr_read(lr->src_reader, &lr->in);
+    if (ret < 0) {
+        lr->src_failed = 1;
+        lz4_reader_fail(lr, "source read failed");
+    }
+    else if (ret == 0) {
+        lr->in.size = 0;
+        lr->src_eof = 1;
+    }
+    return ret;
+}
+
+/* Points seg at the next n input bytes, straight into the source segment if
+ * they are all there, or else into the staging buffer.  Either way seg stays
+ * valid until the next call.  Returns 1, 0 on EOF before the first byte, or
+ * -1 on error (EOF later on included). */
+static int lz4_reader_take(struct lz4_reader_t *lr, size_t n, ro_seg_t *seg)
+{
+    seg_t staged;
+
+    if (lr->in.size >= n && lr->in.size > 0) {
+        seg->start = lr->in.start;
+        seg->size = n;
+        ro_seg_trim_front(&lr->in, n);
+        return 1;
+    }
+
+    char_buffer_clear(&lr->staged);
+    for (;;) {
+        const size_t missing = n - char_buffer_size(&lr->staged);
+        const size_t k = lr->in.size < missing ? lr->in.size : missing;
+        int ret;
+
+        if (k > 0) {
+            char_buffer_append(&lr->staged, lr->in.start, k);
+            ro_seg_trim_front(&lr->in, k);
+        }
+        if (k == missing)
+            break;
+
+        ret = lz4_reader_pull(lr);
+        if (ret < 0)
+            return -1;
+        if (ret == 0) {
+            if (char_buffer_size(&lr->staged) == 0)
+                return 0;
+            return lz4_reader_fail(lr, "unexpected end of compressed data");
+        }
+    }
+    char_buffer_get(&lr->staged, &staged);
+    seg->start = staged.start;
+    seg->size = n;
+    return 1;
+}
+
+/* lz4_reader_take() where running out of input is an error */
+static int lz4_reader_need(struct lz4_reader_t *lr, size_t n, ro_seg_t *seg)
+{
+    const int ret = lz4_reader_take(lr, n, seg);
+    if (ret == 0)
+        return lz4_reader_fail(lr, "unexpected end of compressed data");
+    return ret;
+}
+
+static int lz4_reader_skip(struct lz4_reader_t *lr, size_t n)
+{
+    while (n > 0) {
+        size_t k;
+        if (lr->in.size == 0) {
+            const int ret = lz4_reader_pull(lr);
+            if (ret < 0)
+                return -1;
+            if (ret == 0)
+                return lz4_reader_fail(lr, "unexpected end of compressed data");
+        }
+        k = lr->in.size < n ? lr->in.size : n;
+        ro_seg_trim_front(&lr->in, k);
+        n -= k;
+    }
+    return 0;
+}
+
+/* returns 1 after a frame header or a skippable frame, 0 on a clean EOF or
+ * -1 on error */
+static int lz4_reader_frame_header(struct lz4_reader_t *lr)
+{
+    char desc[2 + 8 + 4 + 1];
+    size_t desc_size;
+    unsigned flg, bd;
+    uint32_t magic;
+    size_t need;
+    ro_seg_t seg;
+    int ret;
+
+    ret = lz4_reader_take(lr, 4, &seg);
+    if (ret <= 0)
+        return ret;
+    magic = read_le32(seg.start);
+
+    if ((magic & LZ4_SKIPPABLE_MASK) == LZ4_SKIPPABLE_MAGIC) {
+        if (lz4_reader_need(lr, 4, &seg) < 0)
+            return -1;
+        if (lz4_reader_skip(lr, read_le32(seg.start)) < 0)
+            return -1;
+        return 1;
+    }
+    if (magic != LZ4_MAGIC)
+        return lz4_reader_fail(lr, "not an LZ4 frame");
+
+    if (lz4_reader_need(lr, 2, &seg) < 0)
+        return -1;
+    memcpy(desc, seg.start, 2);
+    flg = (unsigned char)desc[0];
+    bd = (unsigned char)desc[1];
+    if ((flg & 0xc0) != LZ4_FLG_VERSION || (flg & 0x02) != 0 ||
+        (bd & 0x8f) != 0 || (bd >> 4) < 4)
+        return lz4_reader_fail(lr, "unsupported LZ4 frame descriptor");
+    if (flg & LZ4_FLG_DICT_ID)
+        return lz4_reader_fail(lr, "LZ4 dictionaries are not supported");
+
+    desc_size = 2 + (flg & LZ4_FLG_CONTENT_SIZE ? 8 : 0);
+    if (lz4_reader_need(lr, desc_size - 2 + 1, &seg) < 0)
+        return -1;
+    memcpy(desc + 2, seg.start, desc_size - 2 + 1);
+    if (((hash32(desc, desc_size, 0) >> 8) & 0xff) !=
+        (unsigned char)desc[desc_size])
+        return lz4_reader_fail(lr, "LZ4 frame descriptor checksum mismatch");
+
+    lr->linked = !(flg & LZ4_FLG_BLOCK_INDEP);
+    lr->block_checksum = (flg & LZ4_FLG_BLOCK_CHECKSUM) != 0;
+    lr->content_checksum = (flg & LZ4_FLG_CONTENT_CHECKSUM) != 0;
+    lr->has_content_size = (flg & LZ4_FLG_CONTENT_SIZE) != 0;
+    lr->content_size = 0;
+    if (lr->has_content_size)
+        lr->content_size = (uint64_t)read_le32(desc + 2) |
+                           ((uint64_t)read_le32(desc + 6) << 32);
+    lr->produced = 0;
+    lr->block_max = (size_t)1 << (8 + 2 * (bd >> 4));
+    hash32_state_init(&lr->checksum, 0);
+
+    /* the buffer is kept from frame to frame, and only ever grows */
+    need = (lr->linked ? LZ4_WINDOW : 0) + lr->block_max;
+    if (need > lr->out_cap) {
+        free(lr->out);
+        lr->out = (char *)malloc(need);
+        lr->out_cap = need;
+    }
+    lr->out_pos = 0;
+    lr->in_frame = 1;
+    return 1;
+}
+
+static int lz4_reader_frame_end(struct lz4_reader_t *lr)
+{
+    ro_seg_t seg;
+
+    lr->in_frame = 0;
+    if (lr->content_checksum) {
+        if (lz4_reader_need(lr, 4, &seg) < 0)
+            return -1;
+        if (read_le32(seg.start) != hash32_state_final(&lr->checksum))
+            return lz4_reader_fail(lr, "LZ4 content checksum mismatch");
+    }
+    if (lr->has_content_size && lr->produced != lr->content_size)
+        return lz4_reader_fail(lr, "LZ4 content size mismatch");
+    return 0;
+}
+
+/* decodes the next block of the frame into seg; returns 1, 0 after the last
+ * block or -1 on error */
+static int lz4_reader_block(struct lz4_reader_t *lr, ro_seg_t *seg)
+{
+    uint32_t header;
+    size_t size;
+    ro_seg_t data;
+
+    if (lz4_reader_need(lr, 4, &data) < 0)
+        return -1;
+    header = read_le32(data.start);
+    if (header == 0)
+        return lz4_reader_frame_end(lr);
+
+    size = header & ~LZ4_BLOCK_UNCOMPRESSED;
+    if (size > lr->block_max)
+        return lz4_reader_fail(lr, "LZ4 block too large");
+    if (lz4_reader_need(lr, size + (lr->block_checksum ? 4 : 0), &data) < 0)
+        return -1;
+    data.size = size;
+    if (lr->block_checksum &&
+        read_le32(data.start + size) != hash32(data.start, size, 0))
+        return lz4_reader_fail(lr, "LZ4 block checksum mismatch");
+
+    if (lr->linked && lr->out_pos > LZ4_WINDOW) {
+        memmove(lr->out, lr->out + lr->out_pos - LZ4_WINDOW, LZ4_WINDOW);
+        lr->out_pos = LZ4_WINDOW;
+    }
+
+    if (header & LZ4_BLOCK_UNCOMPRESSED) {
+        if (!lr->linked) {
+            /* nothing refers back to it, so hand it out in place */
+            ro_seg_assign(seg, &data);
+            return 1;
+        }
+        memcpy(lr->out + lr->out_pos, data.start, size);
+    }
+    else {
+        const int ret = lz4_decompress_prefix(&data,
+                                              lr->out + lr->out_pos,
+                                              lr->block_max,
+                                              lr->out_pos);
+        if (ret < 0)
+            return lz4_reader_fail(lr, "corrupt LZ4 block");
+        size = (size_t)ret;
+    }
+
+    seg->start = lr->out + lr->out_pos;
+    seg->size = size;
+    if (lr->linked)
+        lr->out_pos += size;
+    return 1;
+}
+
+static int lz4_reader_open(void *data)
+{
+    struct lz4_reader_t *lr = (struct lz4_reader_t *)data;
+    return strrdr_open(lr->src_reader);
+}
+
+static int lz4_reader_read(void *data, ro_seg_t *seg)
+{
+    struct lz4_reader_t *lr = (struct lz4_reader_t *)data;
+
+    for (;;) {
+        int ret;
+
+        if (lr->failed)
+            return -1;
+
+        if (!lr->in_frame) {
+            ret = lz4_reader_frame_header(lr);
+            if (ret <= 0)
+                return ret;
+            continue;
+        }
+
+        ret = lz4_reader_block(lr, seg);
+        if (ret < 0)
+            return -1;
+        if (ret > 0 && seg->size > 0) {
+            hash32_state_update(&lr->checksum, seg);
+            lr->produced += seg->size;
+            return (int)seg->size;
+        }
+    }
+}
+
+static void lz4_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    struct lz4_reader_t *lr = (struct lz4_reader_t *)data;
+    if (lr->src_failed) {
+        strrdr_get_error(lr->src_reader, buf, errnum);
+        return;
+    }
+    *buf = lr->error;
+    *errnum = 0;
+}
+
+void po_lz4_reader_init(struct strrdr_t *reader, struct strrdr_t *src_reader)
+{
+    struct lz4_reader_t *lr = (struct lz4_reader_t *)malloc(sizeof(struct lz4_reader_t));
+    assert(reader != NULL);
+    lr->src_reader = src_reader;
+    lr->in.start = NULL;
+    lr->in.size = 0;
+    lr->src_eof = 0;
+    char_buffer_init(&lr->staged);
+    lr->in_frame = 0;
+    lr->linked = 0;
+    lr->block_checksum = 0;
+    lr->content_checksum = 0;
+    lr->has_content_size = 0;
+    lr->content_size = 0;
+    lr->produced = 0;
+    lr->block_max = 0;
+    lr->out = NULL;
+    lr->out_cap = 0;
+    lr->out_pos = 0;
+    lr->failed = 0;
+    lr->src_failed = 0;
+    lr->error = "";
+    reader->data = lr;
+    reader->open = lz4_reader_open;
+    reader->read = lz4_reader_read;
+    reader->get_error = lz4_reader_get_error;
+}
+
+void po_lz4_reader_uninit(struct strrdr_t *reader)
+{
+    struct lz4_reader_t *lr = (struct lz4_reader_t *)reader->data;
+    char_buffer_uninit(&lr->staged);
+    free(lr->out);
+    free(lr);
+}
+
+/* frame writer */
+
+struct lz4_writer_t
+{
+    struct strwtr_t *dst_writer;
+    size_t block_size;
+    unsigned block_code;  /* for the BD byte */
+    char *block;
+    size_t used;
+    char *out;  /* block header and compressed data */
+    struct lz4_state_t state;
+    struct hash32_state_t checksum;
+    int opened;
+    int finished;
+    int failed;
+    int dst_failed;  /* the error comes from the destination writer */
+    const char *error;
+};
+
+static int lz4_writer_put(struct lz4_writer_t *lw, const char *buf, size_t size)
+{
+    ro_seg_t seg;
+    seg.start = buf;
+    seg.size = size;
+    if (strwtr_write(lw->dst_writer, &seg) < 0) {
+        lw->failed = 1;
+        lw->dst_failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static int lz4_writer_emit(struct lz4_writer_t *lw, const ro_seg_t *block)
+{
+    size_t size;
+
+    hash32_state_update(&lw->checksum, block);
+    size = lz4_compress(&lw->state, block, lw->out + 4);
+    if (size < block->size) {
+        write_le32(lw->out, (uint32_t)size);
+        return lz4_writer_put(lw, lw->out, 4 + size);
+    }
+
+    /* incompressible, store it as it is */
+    write_le32(lw->out, (uint32_t)block->size | LZ4_BLOCK_UNCOMPRESSED);
+    if (lz4_writer_put(lw, lw->out, 4) < 0)
+        return -1;
+    return lz4_writer_put(lw, block->start, block->size);
+}
+
+static int lz4_writer_emit_buffered(struct lz4_writer_t *lw)
+{
+    ro_seg_t seg;
+
+    if (lw->used == 0)
+        return 0;
+    seg.start = lw->block;
+    seg.size = lw->used;
+    lw->used = 0;
+    return lz4_writer_emit(lw, &seg);
+}
+
+static int lz4_writer_open(void *data)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)data;
+    char header[7];
+
+    if (strwtr_open(lw->dst_writer) < 0) {
+        lw->failed = 1;
+        lw->dst_failed = 1;
+        return -1;
+    }
+    lw->opened = 1;
+    lw->finished = 0;
+    lw->failed = 0;
+    lw->dst_failed = 0;
+    lw->used = 0;
+    hash32_state_init(&lw->checksum, 0);
+
+    write_le32(header, LZ4_MAGIC);
+    header[4] = (char)(LZ4_FLG_VERSION | LZ4_FLG_BLOCK_INDEP |
+                       LZ4_FLG_CONTENT_CHECKSUM);
+    header[5] = (char)(lw->block_code << 4);
+    header[6] = (char)((hash32(header + 4, 2, 0) >> 8) & 0xff);
+    return lz4_writer_put(lw, header, sizeof(header));
+}
+
+static int lz4_writer_write(void *data, const ro_seg_t *seg)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)data;
+    ro_seg_t rest;
+
+    if (lw->failed)
+        return -1;
+    assert(!lw->finished);
+
+    ro_seg_assign(&rest, seg);
+    while (rest.size > 0) {
+        if (lw->used == 0 && rest.size >= lw->block_size) {
+            /* a whole block is already there, no need to copy it */
+            ro_seg_t block;
+            block.start = rest.start;
+            block.size = lw->block_size;
+            if (lz4_writer_emit(lw, &block) < 0)
+                return -1;
+            ro_seg_trim_front(&rest, lw->block_size);
+        }
+        else {
+            const size_t room = lw->block_size - lw->used;
+            const size_t k = rest.size < room ? rest.size : room;
+            memcpy(lw->block + lw->used, rest.start, k);
+            lw->used += k;
+            ro_seg_trim_front(&rest, k);
+            if (lw->used == lw->block_size && lz4_writer_emit_buffered(lw) < 0)
+                return -1;
+        }
+    }
+    return 0;
+}
+
+static int lz4_writer_flush(void *data)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)data;
+
+    if (lw->failed)
+        return -1;
+    if (lz4_writer_emit_buffered(lw) < 0)
+        return -1;
+    if (strwtr_flush(lw->dst_writer) < 0) {
+        lw->failed = 1;
+        lw->dst_failed = 1;
+        return -1;
+    }
+    return 0;
+}
+
+static void lz4_writer_get_error(void *data, const char **buf, int *errnum)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)data;
+    if (lw->dst_failed) {
+        strwtr_get_error(lw->dst_writer, buf, errnum);
+        return;
+    }
+    *buf = lw->error;
+    *errnum = 0;
+}
+
+void po_lz4_writer_init(struct strwtr_t *writer,
+                        struct strwtr_t *dst_writer,
+                        size_t block_size)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)malloc(sizeof(struct lz4_writer_t));
+    assert(writer != NULL);
+    lw->dst_writer = dst_writer;
+    for (lw->block_code = 4; lw->block_code < 7; ++lw->block_code) {
+        if (block_size <= (size_t)1 << (8 + 2 * lw->block_code))
+            break;
+    }
+    assert(block_size == (size_t)1 << (8 + 2 * lw->block_code));
+    lw->block_size = block_size;
+    lw->block = (char *)malloc(block_size);
+    lw->used = 0;
+    lw->out = (char *)malloc(4 + lz4_compress_bound(block_size));
+    lw->opened = 0;
+    lw->finished = 0;
+    lw->failed = 0;
+    lw->dst_failed = 0;
+    lw->error = "";
+    writer->data = lw;
+    writer->open = lz4_writer_open;
+    writer->write = lz4_writer_write;
+    writer->flush = lz4_writer_flush;
+    writer->get_error = lz4_writer_get_error;
+}
+
+int po_lz4_writer_finish(struct strwtr_t *writer)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)writer->data;
+    char trailer[8];
+
+    if (lw->failed)
+        return -1;
+    if (lw->finished)
+        return 0;
+    if (lz4_writer_emit_buffered(lw) < 0)
+        return -1;
+    write_le32(trailer, 0);  /* end mark */
+    write_le32(trailer + 4, hash32_state_final(&lw->checksum));
+    if (lz4_writer_put(lw, trailer, sizeof(trailer)) < 0)
+        return -1;
+    lw->finished = 1;
+    return lz4_writer_flush(lw);
+}
+
+void po_lz4_writer_uninit(struct strwtr_t *writer)
+{
+    struct lz4_writer_t *lw = (struct lz4_writer_t *)writer->data;
+    if (lw->opened && !lw->finished)
+        po_lz4_writer_finish(writer);
+    free(lw->out);
+    free(lw->block);
+    free(lw);
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef LZ4_H
+#define LZ4_H
+
+#include "io.h"
+#include "types.h"
+
+/* LZ4 block codec, compatible with the reference implementation's block
+ * format, and a reader and writer for the LZ4 frame format on top of it, so
+ * that files can also be handled with the lz4 command line tool. */
+
+#define LZ4_HASH_LOG 12
+
+/* compressor state; reused from block to block */
+struct lz4_state_t
+{
+    uint32_t table[1 << LZ4_HASH_LOG];
+};
+
+/* the most a block of size bytes can grow to */
+size_t lz4_compress_bound(size_t size);
+/* dst must have room for lz4_compress_bound(src->size) bytes; returns the
+ * compressed size */
+size_t lz4_compress(struct lz4_state_t *state,
+                    const ro_seg_t *src,
+                    char *dst);
+/* returns the decompressed size, or -1 if src is malformed or does not fit
+ * in dst_size bytes */
+int lz4_decompress(const ro_seg_t *src, char *dst, size_t dst_size);
+
+/* Frame reader: decompresses LZ4 frames (also concatenated ones) produced
+ * by a source reader; every block comes back as one segment.  Independent
+ * and linked blocks, and the optional block and content checksums are
+ * supported.  Buffers are allocated when a frame starts and reused for all
+ * of its blocks. */
+void po_lz4_reader_init(struct strrdr_t *reader, struct strrdr_t *src_reader);
+void po_lz4_reader_uninit(struct strrdr_t *reader);
+
+/* Frame writer: collects writes into independent blocks of block_size bytes
+ * (64 KB, 256 KB, 1 MB or 4 MB), compresses them into a preallocated buffer
+ * and writes them to dst_writer, followed by a content checksum.  A flush
+ * ends the current block early.  po_lz4_writer_finish() ends the frame;
+ * uninit does it if it has not been done. */
+
+#define LZ4_WRITER_BLOCK_SIZE (64 * 1024)
+
+void po_lz4_writer_init(struct strwtr_t *writer,
+                        struct strwtr_t *dst_writer,
+                        size_t block_size);
+int po_lz4_writer_finish(struct strwtr_t *writer);
+void po_lz4_writer_uninit(struct strwtr_t *writer);
+
+#endif  /* LZ4_H */
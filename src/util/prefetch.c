@@ -0,0 +1,210 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "prefetch.h"
+#include "thread.h"
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+struct prefetch_slot_t
+{
+    char *buf;
+    size_t capacity;
+    int result;  /* block size, 0 on EOF or negative on error */
+};
+
+/* The ring indices only ever grow: the producer owns the slots in
+ * [tail, head + depth) and the consumer those in [head, tail).  Publishing
+ * an index is lock-free; the mutex and condition variables are used only
+ * when one side has to sleep, and the waiting flags let the other side skip
+ * them otherwise. */
+struct prefetch_reader_t
+{
+    struct strrdr_t *src_reader;
+    struct prefetch_slot_t *slots;
+    size_t depth;
+    volatile long head;
+    volatile long tail;
+    volatile long stop;
+    volatile long consumer_waiting;
+    volatile long producer_waiting;
+    mutex_t mutex;
+    cond_t not_empty;
+    cond_t not_full;
+    thread_t thread;
+    int started;
+    int holds_slot;  /* the consumer has yet to release the slot at head */
+};
+
+static size_t prefetch_reader_used(struct prefetch_reader_t *pr)
+{
+    return (size_t)((unsigned long)atomic_get(&pr->tail) -
+                    (unsigned long)atomic_get(&pr->head));
+}
+
+static void prefetch_reader_advance(struct prefetch_reader_t *pr,
+                                    volatile long *index,
+                                    volatile long *other_waiting,
+                                    cond_t *other_cond)
+{
+    atomic_set(index, (long)((unsigned long)atomic_get(index) + 1));
+    if (atomic_get(other_waiting)) {
+        mutex_lock(&pr->mutex);
+        cond_signal(other_cond);
+        mutex_unlock(&pr->mutex);
+    }
+}
+
+/* sleeps until the ring is not full (producer) or not empty (consumer), or
+ * until the reader is stopped */
+static void prefetch_reader_wait(struct prefetch_reader_t *pr, int producer)
+{
+    volatile long *waiting = producer ? &pr->producer_waiting : &pr->consumer_waiting;
+    cond_t *cond = producer ? &pr->not_full : &pr->not_empty;
+
+    mutex_lock(&pr->mutex);
+    atomic_set(waiting, 1);
+    while (!atomic_get(&pr->stop)) {
+        const size_t used = prefetch_reader_used(pr);
+        if (producer ? used < pr->depth : used > 0)
+            break;
+        cond_wait(cond, &pr->mutex);
+    }
+    atomic_set(waiting, 0);
+    mutex_unlock(&pr->mutex);
+}
+
+static void prefetch_reader_run(void *arg)
+{
+    struct prefetch_reader_t *pr = (struct prefetch_reader_t *)arg;
+    ro_seg_t seg;
+
+    while (1) {
+        struct prefetch_slot_t *slot;
+        int ret;
+
+        if (prefetch_reader_used(pr) == pr->depth)
+            prefetch_reader_wait(pr, 1);
+        if (atomic_get(&pr->stop))
+            break;
+
+        slot = &pr->slots[(unsigned long)atomic_get(&pr->tail) % pr->depth];
+        ret = strrdr_read(pr->src_reader, &seg);
+        if (ret > 0) {
+            if (seg.size > slot->capacity) {
+                free(slot->buf);
+                slot->buf = (char *)malloc(seg.size);
+                slot->capacity = seg.size;
+            }
+            memcpy(slot->buf, seg.start, seg.size);
+        }
+        slot->result = ret;
+        prefetch_reader_advance(pr, &pr->tail, &pr->consumer_waiting, &pr->not_empty);
+        if (ret <= 0)
+            break;
+    }
+}
+
+static int prefetch_reader_open(void *data)
+{
+    struct prefetch_reader_t *pr = (struct prefetch_reader_t *)data;
+    int ret;
+
+    if ((ret = strrdr_open(pr->src_reader)) < 0)
+        return ret;
+    if (thread_create(&pr->thread, prefetch_reader_run, pr) < 0)
+        return -1;
+    pr->started = 1;
+    return 0;
+}
+
+static int prefetch_reader_read(void *data, ro_seg_t *seg)
+{
+    struct prefetch_reader_t *pr = (struct prefetch_reader_t *)data;
+    const struct prefetch_slot_t *slot;
+
+    if (pr->holds_slot) {
+        prefetch_reader_advance(pr, &pr->head, &pr->producer_waiting, &pr->not_full);
+        pr->holds_slot = 0;
+    }
+
+    if (prefetch_reader_used(pr) == 0)
+        prefetch_reader_wait(pr, 0);
+
+    /* EOF and errors stay at the head of the ring */
+    slot = &pr->slots[(unsigned long)atomic_get(&pr->head) % pr->depth];
+    if (slot->result > 0) {
+        seg->start = slot->buf;
+        seg->size = (size_t)slot->result;
+        pr->holds_slot = 1;
+    }
+    return slot->result;
+}
+
+static void prefetch_reader_get_error(void *data, const char **buf, int *errnum)
+{
+    struct prefetch_reader_t *pr = (struct prefetch_reader_t *)data;
+    strrdr_get_error(pr->src_reader, buf, errnum);
+}
+
+void po_prefetch_reader_init(struct strrdr_t *reader,
+                             struct strrdr_t *src_reader,
+                             size_t depth)
+{
+    struct prefetch_reader_t *pr = (struct prefetch_reader_t *)malloc(sizeof(struct prefetch_reader_t));
+    assert(reader != NULL);
+    assert(depth > 0);
+    pr->src_reader = src_reader;
+    pr->slots = (struct prefetch_slot_t *)calloc(depth, sizeof(struct prefetch_slot_t));
+    pr->depth = depth;
+    pr->head = 0;
+    pr->tail = 0;
+    pr->stop = 0;
+    pr->consumer_waiting = 0;
+    pr->producer_waiting = 0;
+    mutex_init(&pr->mutex);
+    cond_init(&pr->not_empty);
+    cond_init(&pr->not_full);
+    pr->started = 0;
+    pr->holds_slot = 0;
+    reader->data = pr;
+    reader->open = prefetch_reader_open;
+    reader->read = prefetch_reader_read;
+    reader->get_error = prefetch_reader_get_error;
+}
+
+void po_prefetch_reader_uninit(struct strrdr_t *reader)
+{
+    struct prefetch_reader_t *pr = (struct prefetch_reader_t *)reader->data;
+    size_t i;
+
+    if (pr->started) {
+        mutex_lock(&pr->mutex);
+        atomic_set(&pr->stop, 1);
+        cond_signal(&pr->not_full);
+        mutex_unlock(&pr->mutex);
+        thread_join(&pr->thread);
+    }
+
+    for (i = 0; i < pr->depth; ++i)
+        free(pr->slots[i].buf);
+    free(pr->slots);
+    cond_uninit(&pr->not_full);
+    cond_uninit(&pr->not_empty);
+    mutex_uninit(&pr->mutex);
+    free(pr);
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef PREFETCH_H
+#define PREFETCH_H
+
+#include "io.h"
+
+/* Prefetch reader: runs the source reader on a background thread, which
+ * copies each block it gets into a bounded single-producer/single-consumer
+ * ring of depth buffers.  Reads on the prefetch reader drain the ring, so
+ * any reader gets read-ahead without changes to it.  A segment stays valid
+ * until the next read.
+ *
+ * The source reader is opened on the calling thread and must not be used
+ * by anyone else until the prefetch reader is uninitialized.  Errors are
+ * reported through the source reader's get_error once the read that failed
+ * is reached. */
+
+#define PREFETCH_READER_DEPTH 4
+
+void po_prefetch_reader_init(struct strrdr_t *reader,
+                             struct strrdr_t *src_reader,
+                             size_t depth);
+void po_prefetch_reader_uninit(struct strrdr_t *reader);
+
+#endif  /* PREFETCH_H */
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "rope.h"
+#include <string.h>
+#include <assert.h>
+
+struct rope_chunk_t
+{
+    struct rope_chunk_t *next;
+    size_t size;
+    size_t capacity;
+};
+
+/* the data follows the chunk header */
+#define ROPE_CHUNK_DATA(chunk) ((char *)((chunk) + 1))
+
+static struct rope_chunk_t *rope_new_chunk(struct rope_t *rope,
+                                           size_t capacity)
+{
+    struct rope_chunk_t *chunk = (struct rope_chunk_t *)
+        allocator_alloc(rope->allocator, sizeof(struct rope_chunk_t) + capacity);
+    chunk->next = NULL;
+    chunk->size = 0;
+    chunk->capacity = capacity;
+    return chunk;
+}
+
+static void rope_free_chunk(struct rope_t *rope, struct rope_chunk_t *chunk)
+{
+    allocator_free(rope->allocator, chunk,
+                   sizeof(struct rope_chunk_t) + chunk->capacity);
+}
+
+static void rope_link_chunk(struct rope_t *rope, struct rope_chunk_t *chunk)
+{
+    if (rope->tail != NULL)
+        rope->tail->next = chunk;
+    else
+        rope->head = chunk;
+    rope->tail = chunk;
+}
+
+void rope_init(struct rope_t *rope, size_t chunk_size)
+{
+    rope_init_alloc(rope, chunk_size, NULL);
+}
+
+void rope_init_alloc(struct rope_t *rope,
+                     size_t chunk_size,
+                     struct allocator_t *allocator)
+{
+    rope->head = rope->tail = NULL;
+    rope->size = 0;
+    rope->chunk_size = chunk_size > 0 ? chunk_size : ROPE_DEFAULT_CHUNK_SIZE;
+    rope->allocator = allocator;
+}
+
+void rope_uninit(struct rope_t *rope)
+{
+    rope_clear(rope);
+}
+
+void rope_clear(struct rope_t *rope)
+{
+    struct rope_chunk_t *chunk = rope->head;
+    while (chunk != NULL) {
+        struct rope_chunk_t *next = chunk->next;
+        rope_free_chunk(rope, chunk);
+        chunk = next;
+    }
+    rope->head = rope->tail = NULL;
+    rope->size = 0;
+}
+
+size_t rope_size(struct rope_t *rope)
+{
+    return rope->size;
+}
+
+void rope_append(struct rope_t *rope, const char *buf, size_t sz)
+{
+    rope->size += sz;
+
+    while (sz > 0) {
+        struct rope_chunk_t *tail = rope->tail;
+        size_t len;
+
+        if (tail == NULL || tail->size == tail->capacity) {
+            tail = rope_new_chunk(rope, rope->chunk_size);
+            rope_link_chunk(rope, tail);
+        }
+
+        len = tail->capacity - tail->size;
+        if (len > sz)
+            len = sz;
+        memcpy(ROPE_CHUNK_DATA(tail) + tail->size, buf, len);
+        tail->size += len;
+        buf += len;
+        sz -= len;
+    }
+}
+
+void rope_append_ro_seg(struct rope_t *rope, const ro_seg_t *seg)
+{
+    rope_append(rope, seg->start, seg->size);
+}
+
+void rope_linearize(struct rope_t *rope, seg_t *seg)
+{
+    if (rope->head != NULL && rope->head->next != NULL) {
+        struct rope_chunk_t *whole = rope_new_chunk(rope, rope->size);
+        struct rope_chunk_t *chunk = rope->head;
+        while (chunk != NULL) {
+            struct rope_chunk_t *next = chunk->next;
+            memcpy(ROPE_CHUNK_DATA(whole) + whole->size,
+                   ROPE_CHUNK_DATA(chunk), chunk->size);
+            whole->size += chunk->size;
+            rope_free_chunk(rope, chunk);
+            chunk = next;
+        }
+        assert(whole->size == rope->size);
+        rope->head = rope->tail = whole;
+    }
+
+    if (rope->head != NULL) {
+        seg->start = ROPE_CHUNK_DATA(rope->head);
+        seg->size = rope->head->size;
+    }
+    else {
+        seg->start = NULL;
+        seg->size = 0;
+    }
+}
+
+void rope_iter_init(struct rope_iter_t *iter, const struct rope_t *rope)
+{
+    iter->chunk = rope->head;
+}
+
+int rope_iter_next(struct rope_iter_t *iter, ro_seg_t *seg)
+{
+    if (iter->chunk == NULL)
+        return 0;
+
+    seg->start = ROPE_CHUNK_DATA(iter->chunk);
+    seg->size = iter->chunk->size;
+    iter->chunk = iter->chunk->next;
+    return 1;
+}
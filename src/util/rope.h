@@ -0,0 +1,65 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ROPE_H
+#define ROPE_H
+
+#include "str.h"
+#include "alloc.h"
+
+/* rope_t: a char buffer made of a list of fixed-size chunks.  Unlike
+ * char_buffer_t, appending never moves the data which is already in the
+ * buffer, at the cost of the contents not being contiguous.  The contents
+ * are read back piece by piece with rope_iter_t, or as one segment after
+ * rope_linearize(). */
+
+#define ROPE_DEFAULT_CHUNK_SIZE (64 * 1024)
+
+struct rope_chunk_t;
+
+struct rope_t
+{
+    struct rope_chunk_t *head;
+    struct rope_chunk_t *tail;
+    size_t size;
+    size_t chunk_size;
+    struct allocator_t *allocator;
+};
+
+/* chunk_size of 0 selects ROPE_DEFAULT_CHUNK_SIZE */
+void rope_init(struct rope_t *rope, size_t chunk_size);
+void rope_init_alloc(struct rope_t *rope,
+                     size_t chunk_size,
+                     struct allocator_t *allocator);
+void rope_uninit(struct rope_t *rope);
+void rope_clear(struct rope_t *rope);
+size_t rope_size(struct rope_t *rope);
+void rope_append(struct rope_t *rope, const char *buf, size_t sz);
+void rope_append_ro_seg(struct rope_t *rope, const ro_seg_t *seg);
+/* moves the contents into a single contiguous chunk (if they are not in one
+ * already) and returns it; appending afterwards adds new chunks behind it */
+void rope_linearize(struct rope_t *rope, seg_t *seg);
+
+struct rope_iter_t
+{
+    const struct rope_chunk_t *chunk;
+};
+
+void rope_iter_init(struct rope_iter_t *iter, const struct rope_t *rope);
+/* returns 1 and the next piece of the contents in seg, or 0 at the end */
+int rope_iter_next(struct rope_iter_t *iter, ro_seg_t *seg);
+
+#endif  /* ROPE_H */
@@ -0,0 +1,385 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "scan.h"
+#include <string.h>
+#include <assert.h>
+
+#ifdef SCAN_X86
+#   ifdef _MSC_VER
+#       include <intrin.h>
+#   endif
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#endif
+
+#define IS_DIGIT(c) ((c) >= '0' && (c) <= '9')
+
+struct scan_impl_t
+{
+    size_t (* find_byte)(const char *, size_t, char);
+    size_t (* find_first_of)(const char *, size_t, const char *, size_t);
+    size_t (* count_byte)(const char *, size_t, char);
+    size_t (* find_non_digit)(const char *, size_t);
+};
+
+/* portable */
+
+static size_t portable_find_byte(const char *buf, size_t size, char c)
+{
+    const char *found = (const char *)memchr(buf, c, size);
+    return found != NULL ? (size_t)(found - buf) : size;
+}
+
+static size_t portable_find_first_of(const char *buf,
+                                     size_t size,
+                                     const char *set,
+                                     size_t set_size)
+{
+    size_t i, j;
+    for (i = 0; i < size; ++i) {
+        for (j = 0; j < set_size; ++j) {
+            if (buf[i] == set[j])
+                return i;
+        }
+    }
+    return size;
+}
+
+static size_t portable_count_byte(const char *buf, size_t size, char c)
+{
+    size_t i, n = 0;
+    for (i = 0; i < size; ++i)
+        n += buf[i] == c;
+    return n;
+}
+
+static size_t portable_find_non_digit(const char *buf, size_t size)
+{
+    size_t i;
+    for (i = 0; i < size; ++i) {
+        if (!IS_DIGIT(buf[i]))
+            return i;
+    }
+    return size;
+}
+
+static const struct scan_impl_t portable_impl = {
+    portable_find_byte,
+    portable_find_first_of,
+    portable_count_byte,
+    portable_find_non_digit
+};
+
+#ifdef SCAN_X86
+
+static unsigned scan_ctz(unsigned mask)
+{
+    assert(mask != 0);
+#ifdef _MSC_VER
+    {
+        unsigned long idx;
+        _BitScanForward(&idx, mask);
+        return (unsigned)idx;
+    }
+#else
+    return (unsigned)__builtin_ctz(mask);
+#endif
+}
+
+/* counters in 8-bit lanes may be incremented at most this many times before
+ * they have to be added up */
+#define SCAN_MAX_LANE_COUNT 255
+
+/* SSE2 */
+
+SCAN_TARGET_SSE2
+static size_t sse2_find_byte(const char *buf, size_t size, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        const unsigned mask =
+            (unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(v, needle));
+        if (mask != 0)
+            return i + scan_ctz(mask);
+    }
+    return i + portable_find_byte(buf + i, size - i, c);
+}
+
+SCAN_TARGET_SSE2
+static size_t sse2_find_first_of(const char *buf,
+                                 size_t size,
+                                 const char *set,
+                                 size_t set_size)
+{
+    size_t i = 0, j;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        __m128i hits = _mm_setzero_si128();
+        unsigned mask;
+        for (j = 0; j < set_size; ++j)
+            hits = _mm_or_si128(hits, _mm_cmpeq_epi8(v, _mm_set1_epi8(set[j])));
+        mask = (unsigned)_mm_movemask_epi8(hits);
+        if (mask != 0)
+            return i + scan_ctz(mask);
+    }
+    return i + portable_find_first_of(buf + i, size - i, set, set_size);
+}
+
+SCAN_TARGET_SSE2
+static size_t sse2_count_byte(const char *buf, size_t size, char c)
+{
+    const __m128i needle = _mm_set1_epi8(c);
+    size_t i = 0, n = 0;
+    while (i + 16 <= size) {
+        /* matches are -1, so subtracting them counts in each lane */
+        __m128i acc = _mm_setzero_si128();
+        unsigned k;
+        for (k = 0; k < SCAN_MAX_LANE_COUNT && i + 16 <= size; ++k, i += 16) {
+            const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpeq_epi8(v, needle));
+        }
+        acc = _mm_sad_epu8(acc, _mm_setzero_si128());
+        n += (size_t)_mm_cvtsi128_si32(acc) +
+             (size_t)_mm_cvtsi128_si32(_mm_srli_si128(acc, 8));
+    }
+    return n + portable_count_byte(buf + i, size - i, c);
+}
+
+SCAN_TARGET_SSE2
+static size_t sse2_find_non_digit(const char *buf, size_t size)
+{
+    const __m128i zero = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    size_t i = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        /* a digit is at most 9 after subtracting '0' (compared unsigned) */
+        const __m128i d = _mm_sub_epi8(v, zero);
+        const unsigned mask = 0xffff &
+            ~(unsigned)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_min_epu8(d, nine), d));
+        if (mask != 0)
+            return i + scan_ctz(mask);
+    }
+    return i + portable_find_non_digit(buf + i, size - i);
+}
+
+static const struct scan_impl_t sse2_impl = {
+    sse2_find_byte,
+    sse2_find_first_of,
+    sse2_count_byte,
+    sse2_find_non_digit
+};
+
+/* AVX2 */
+
+SCAN_TARGET_AVX2
+static size_t avx2_find_byte(const char *buf, size_t size, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        const unsigned mask =
+            (unsigned)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, needle));
+        if (mask != 0)
+            return i + scan_ctz(mask);
+    }
+    return i + sse2_find_byte(buf + i, size - i, c);
+}
+
+SCAN_TARGET_AVX2
+static size_t avx2_find_first_of(const char *buf,
+                                 size_t size,
+                                 const char *set,
+                                 size_t set_size)
+{
+    size_t i = 0, j;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        __m256i hits = _mm256_setzero_si256();
+        unsigned mask;
+        for (j = 0; j < set_size; ++j)
+            hits = _mm256_or_si256(hits,
+                _mm256_cmpeq_epi8(v, _mm256_set1_epi8(set[j])));
+        mask = (unsigned)_mm256_movemask_epi8(hits);
+        if (mask != 0)
+            return i + scan_ctz(mask);
+    }
+    return i + sse2_find_first_of(buf + i, size - i, set, set_size);
+}
+
+SCAN_TARGET_AVX2
+static size_t avx2_count_byte(const char *buf, size_t size, char c)
+{
+    const __m256i needle = _mm256_set1_epi8(c);
+    size_t i = 0, n = 0;
+    while (i + 32 <= size) {
+        __m256i acc = _mm256_setzero_si256();
+        __m128i sum;
+        unsigned k;
+        for (k = 0; k < SCAN_MAX_LANE_COUNT && i + 32 <= size; ++k, i += 32) {
+            const __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpeq_epi8(v, needle));
+        }
+        acc = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        sum = _mm_add_epi64(_mm256_castsi256_si128(acc),
+                            _mm256_extracti128_si256(acc, 1));
+        n += (size_t)_mm_cvtsi128_si32(sum) +
+             (size_t)_mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+    }
+    return n + sse2_count_byte(buf + i, size - i, c);
+}
+
+SCAN_TARGET_AVX2
+static size_t avx2_find_non_digit(const char *buf, size_t size)
+{
+    const __m256i zero = _mm256_set1_epi8('0');
+    const __m256i nine = _mm256_set1_epi8(9);
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32) {
+        const __m256i v = _mm256_loadu_si256((const __m256i *)(buf + i));
+        const __m256i d = _mm256_sub_epi8(v, zero);
+        const unsigned mask = ~(unsigned)_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(_mm256_min_epu8(d, nine), d));
+        if (mask != 0)
+            return i + scan_ctz(mask);
+    }
+    return i + sse2_find_non_digit(buf + i, size - i);
+}
+
+static const struct scan_impl_t avx2_impl = {
+    avx2_find_byte,
+    avx2_find_first_of,
+    avx2_count_byte,
+    avx2_find_non_digit
+};
+
+static int cpu_has_sse2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 1);
+    return (info[3] & (1 << 26)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("sse2");
+#endif
+}
+
+static int cpu_has_avx2(void)
+{
+#ifdef _MSC_VER
+    int info[4];
+    __cpuid(info, 0);
+    if (info[0] < 7)
+        return 0;
+    __cpuid(info, 1);
+    /* the OS has to save the ymm registers as well (OSXSAVE + XCR0) */
+    if ((info[2] & (1 << 27)) == 0 || (_xgetbv(0) & 6) != 6)
+        return 0;
+    __cpuid(info, 7);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif  /* SCAN_X86 */
+
+/* NULL until the first use; selecting the implementation more than once
+ * (from racing threads) is harmless as the result is always the same */
+static const struct scan_impl_t *scan_impl = NULL;
+
+static const struct scan_impl_t *scan_select_impl(void)
+{
+#ifdef SCAN_X86
+    if (cpu_has_avx2())
+        return &avx2_impl;
+    if (cpu_has_sse2())
+        return &sse2_impl;
+#endif
+    return &portable_impl;
+}
+
+static const struct scan_impl_t *get_scan_impl(void)
+{
+    if (scan_impl == NULL)
+        scan_impl = scan_select_impl();
+    return scan_impl;
+}
+
+int scan_set_isa(enum scan_isa_t isa)
+{
+    switch (isa) {
+    case SCAN_ISA_PORTABLE:
+        scan_impl = &portable_impl;
+        return 0;
+#ifdef SCAN_X86
+    case SCAN_ISA_SSE2:
+        if (!cpu_has_sse2())
+            return -1;
+        scan_impl = &sse2_impl;
+        return 0;
+    case SCAN_ISA_AVX2:
+        if (!cpu_has_avx2())
+            return -1;
+        scan_impl = &avx2_impl;
+        return 0;
+#endif
+    default:
+        return -1;
+    }
+}
+
+enum scan_isa_t scan_get_isa(void)
+{
+    const struct scan_impl_t *impl = get_scan_impl();
+#ifdef SCAN_X86
+    if (impl == &avx2_impl)
+        return SCAN_ISA_AVX2;
+    if (impl == &sse2_impl)
+        return SCAN_ISA_SSE2;
+#endif
+    assert(impl == &portable_impl);
+    return SCAN_ISA_PORTABLE;
+}
+
+size_t ro_seg_find_byte(const ro_seg_t *seg, char c)
+{
+    return get_scan_impl()->find_byte(seg->start, seg->size, c);
+}
+
+size_t ro_seg_find_first_of(const ro_seg_t *seg,
+                            const char *set,
+                            size_t set_size)
+{
+    return get_scan_impl()->find_first_of(seg->start, seg->size,
+                                          set, set_size);
+}
+
+size_t ro_seg_count_byte(const ro_seg_t *seg, char c)
+{
+    return get_scan_impl()->count_byte(seg->start, seg->size, c);
+}
+
+size_t ro_seg_find_non_digit(const ro_seg_t *seg)
+{
+    return get_scan_impl()->find_non_digit(seg->start, seg->size);
+}
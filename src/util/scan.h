@@ -0,0 +1,62 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SCAN_H
+#define SCAN_H
+
+#include "str.h"
+
+/* Byte-search kernels shared by the scanners in the library.  On x86 the
+ * SSE2 or AVX2 implementation is picked at runtime, based on what the CPU
+ * supports; elsewhere a portable implementation is used.
+ *
+ * The find functions return the offset of the match within seg, or
+ * seg->size if there is no match. */
+
+size_t ro_seg_find_byte(const ro_seg_t *seg, char c);
+/* finds the first byte which is any of the set_size bytes in set; meant for
+ * small sets such as {'"', '\\'} */
+size_t ro_seg_find_first_of(const ro_seg_t *seg,
+                            const char *set,
+                            size_t set_size);
+size_t ro_seg_count_byte(const ro_seg_t *seg, char c);
+/* finds the first byte which is not one of '0'..'9' */
+size_t ro_seg_find_non_digit(const ro_seg_t *seg);
+
+enum scan_isa_t { SCAN_ISA_PORTABLE, SCAN_ISA_SSE2, SCAN_ISA_AVX2 };
+
+/* for the implementations of vectorized kernels */
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#   define SCAN_X86
+#endif
+
+/* gcc and clang only emit vector instructions for functions that ask for
+ * them; msvc always does */
+#if defined(__GNUC__)
+#   define SCAN_TARGET_SSE2 __attribute__((target("sse2")))
+#   define SCAN_TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#   define SCAN_TARGET_SSE2
+#   define SCAN_TARGET_AVX2
+#endif
+
+/* overrides the runtime selection (for unit test and benchmark purposes);
+ * returns -1 if the CPU does not support isa */
+int scan_set_isa(enum scan_isa_t isa);
+enum scan_isa_t scan_get_isa(void);
+
+#endif  /* SCAN_H */
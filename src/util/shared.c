@@ -0,0 +1,105 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "shared.h"
+#include "thread.h"
+#include <string.h>
+#include <assert.h>
+
+/* contents allocated by shared_buf_new() follow the header */
+#define SHARED_BUF_INLINE_DATA(buf) ((char *)((buf) + 1))
+
+struct shared_buf_t *shared_buf_new(size_t size, struct allocator_t *allocator)
+{
+    struct shared_buf_t *buf = (struct shared_buf_t *)
+        allocator_alloc(allocator, sizeof(struct shared_buf_t) + size);
+    buf->refcount = 1;
+    *(char **)&(buf->str.start) = SHARED_BUF_INLINE_DATA(buf);
+    buf->str.size = size;
+    buf->allocator = allocator;
+    return buf;
+}
+
+struct shared_buf_t *shared_buf_take_str(str_t *src)
+{
+    struct shared_buf_t *buf = (struct shared_buf_t *)
+        allocator_alloc(NULL, sizeof(struct shared_buf_t));
+    buf->refcount = 1;
+    memset(&buf->str, 0, sizeof(str_t));
+    str_take_ownership(&buf->str, src);
+    buf->allocator = NULL;
+    return buf;
+}
+
+void shared_buf_ref(struct shared_buf_t *buf)
+{
+    atomic_increment(&buf->refcount);
+}
+
+void shared_buf_unref(struct shared_buf_t *buf)
+{
+    const long refcount = atomic_decrement(&buf->refcount);
+    assert(refcount >= 0);
+    if (refcount > 0)
+        return;
+
+    if (buf->str.start == SHARED_BUF_INLINE_DATA(buf)) {
+        allocator_free(buf->allocator, buf,
+                       sizeof(struct shared_buf_t) + buf->str.size);
+    }
+    else {
+        /* taken over by shared_buf_take_str() */
+        str_uninit(&buf->str);
+        allocator_free(NULL, buf, sizeof(struct shared_buf_t));
+    }
+}
+
+void shared_buf_get(struct shared_buf_t *buf, seg_t *seg)
+{
+    seg_from_str(seg, &buf->str);
+}
+
+void shared_slice_init(struct shared_slice_t *slice,
+                       struct shared_buf_t *buf,
+                       size_t offset,
+                       size_t size)
+{
+    assert(offset + size <= buf->str.size);
+    shared_buf_ref(buf);
+    slice->buf = buf;
+    slice->seg.start = buf->str.start + offset;
+    slice->seg.size = size;
+}
+
+void shared_slice_sub(struct shared_slice_t *dst,
+                      const struct shared_slice_t *src,
+                      size_t offset,
+                      size_t size)
+{
+    assert(offset + size <= src->seg.size);
+    shared_buf_ref(src->buf);
+    dst->buf = src->buf;
+    dst->seg.start = src->seg.start + offset;
+    dst->seg.size = size;
+}
+
+void shared_slice_release(struct shared_slice_t *slice)
+{
+    if (slice->buf != NULL) {
+        shared_buf_unref(slice->buf);
+        slice->buf = NULL;
+    }
+}
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SHARED_H
+#define SHARED_H
+
+#include "str.h"
+#include "alloc.h"
+
+/* shared_buf_t: reference-counted buffer which can be handed out to several
+ * consumers (possibly on different threads) without copying.  Every
+ * shared_slice_t holds a reference, so the buffer stays alive until the last
+ * slice into it is released.  The count is updated atomically; the
+ * allocator, if any, has to be thread-safe when slices are released on other
+ * threads. */
+
+struct shared_buf_t
+{
+    volatile long refcount;
+    str_t str;
+    struct allocator_t *allocator;
+};
+
+/* both return a buffer with a reference count of 1 */
+struct shared_buf_t *shared_buf_new(size_t size, struct allocator_t *allocator);
+/* takes over the malloc()-ed contents of src without copying them */
+struct shared_buf_t *shared_buf_take_str(str_t *src);
+void shared_buf_ref(struct shared_buf_t *buf);
+void shared_buf_unref(struct shared_buf_t *buf);
+void shared_buf_get(struct shared_buf_t *buf, seg_t *seg);
+
+struct shared_slice_t
+{
+    struct shared_buf_t *buf;
+    ro_seg_t seg;
+};
+
+/* the slice gets its own reference to buf */
+void shared_slice_init(struct shared_slice_t *slice,
+                       struct shared_buf_t *buf,
+                       size_t offset,
+                       size_t size);
+/* dst is a sub-slice of src, relative to the start of src */
+void shared_slice_sub(struct shared_slice_t *dst,
+                      const struct shared_slice_t *src,
+                      size_t offset,
+                      size_t size);
+void shared_slice_release(struct shared_slice_t *slice);
+
+static void shared_slice_get(const struct shared_slice_t *slice, ro_seg_t *seg)
+{
+    ro_seg_assign(seg, &slice->seg);
+}
+
+#endif  /* SHARED_H */
@@ -19,34 +19,72 @@
 #include <string.h>
 
 void str_init(str_t *str, size_t size)
+{
+    str_init_alloc(str, size, NULL);
+}
+
+void str_uninit(str_t *str)
+{
+    str_uninit_alloc(str, NULL);
+}
+
+void str_take_ownership(str_t *dst, str_t *src)
+{
+    str_take_ownership_alloc(dst, src, NULL);
+}
+
+char *dup_str(const char *src)
+{
+    size_t len = strlen(src);
+    char *dup = (char *)malloc(len + 1);
+    memcpy(dup, src, len + 1);
+    return dup;
+}
+
+void str_init_alloc(str_t *str, size_t size, struct allocator_t *allocator)
 {
     if (size > 0) {
-        *(char **)&(str->start) = (char *)malloc(size);
+        *(char **)&(str->start) = (char *)allocator_alloc(allocator, size);
         str->size = size;
     }
     else
         memset(str, 0, sizeof(str_t));
 }
 
-void str_uninit(str_t *str)
+void str_uninit_alloc(str_t *str, struct allocator_t *allocator)
 {
-    free(*(char **)&(str->start));
+    allocator_free(allocator, *(char **)&(str->start), str->size);
 }
 
-void str_take_ownership(str_t *dst, str_t *src)
+void str_realloc_alloc(str_t *str, size_t size, struct allocator_t *allocator)
+{
+    assert(size > 0);
+    *(char **)&(str->start) = (char *)allocator_realloc(
+        allocator, *(char **)&(str->start), str->size, size);
+    str->size = size;
+}
+
+void str_take_ownership_alloc(str_t *dst, str_t *src,
+                              struct allocator_t *allocator)
 {
-    free(*(char **)&(dst->start));
+    allocator_free(allocator, *(char **)&(dst->start), dst->size);
     memcpy(dst, src, sizeof(str_t));
     memset(src, 0, sizeof(str_t));
 }
 
 /* char_buffer_t */
 
-#define CHAR_BUFFER_INIT_CAPACITY 10
-
 void char_buffer_init(struct char_buffer_t *cb)
 {
-    strarray_init(&cb->arr, 1, CHAR_BUFFER_INIT_CAPACITY + 1);
+    char_buffer_init_alloc(cb, NULL);
+}
+
+void char_buffer_init_alloc(struct char_buffer_t *cb,
+                            struct allocator_t *allocator)
+{
+    strarray_init_inline(&cb->arr, 1, cb->inline_buf,
+                         CHAR_BUFFER_INLINE_CAPACITY);
+    cb->arr.allocator = allocator;
     strarray_append(&cb->arr, "", 1);
 }
 
@@ -63,9 +101,14 @@ void char_buffer_uninit(struct char_buffer_t *cb)
 
 void char_buffer_append(struct char_buffer_t *cb, const char *buf, size_t sz)
 {
-    strarray_pop_back(&cb->arr, 1);  /* remove the trailing null char first */
-    strarray_append(&cb->arr, buf, sz);
-    strarray_append(&cb->arr, "", 1);
+    char_buffer_reserve(cb, sz);
+    char_buffer_append_unchecked(cb, buf, sz);
+}
+
+void char_buffer_push_char_slow(struct char_buffer_t *cb, char c)
+{
+    strarray_reserve_more(&cb->arr, 1);
+    char_buffer_push_char_unchecked(cb, c);
 }
 
 void char_buffer_append_ro_seg(struct char_buffer_t *cb, const ro_seg_t *seg)
@@ -110,21 +153,46 @@ size_t char_buffer_size(struct char_buffer_t *cb)
 /* strarray_t */
 
 void strarray_init(strarray_t *arr, size_t element_size, size_t init_capacity)
+{
+    strarray_init_alloc(arr, element_size, init_capacity, NULL);
+}
+
+void strarray_init_alloc(strarray_t *arr, size_t element_size,
+                         size_t init_capacity, struct allocator_t *allocator)
 {
     assert(init_capacity > 0);
-    str_init(&arr->str, element_size * init_capacity);
+    str_init_alloc(&arr->str, element_size * init_capacity, allocator);
+    arr->size = 0;
+    arr->element_size = element_size;
+    arr->offset = 0;
+    arr->inline_buf = NULL;
+    arr->allocator = allocator;
+}
+
+void strarray_init_inline(strarray_t *arr, size_t element_size,
+                          void *buf, size_t capacity)
+{
+    assert(capacity > 0);
+    assert(buf != NULL);
+    *(char **)&(arr->str.start) = (char *)buf;
+    arr->str.size = element_size * capacity;
     arr->size = 0;
     arr->element_size = element_size;
+    arr->offset = 0;
+    arr->inline_buf = (char *)buf;
+    arr->allocator = NULL;
 }
 
 void strarray_clear(strarray_t *arr)
 {
     arr->size = 0;
+    arr->offset = 0;
 }
 
 void strarray_uninit(strarray_t *arr)
 {
-    str_uninit(&arr->str);
+    if (arr->str.start != arr->inline_buf)
+        str_uninit_alloc(&arr->str, arr->allocator);
 }
 
 size_t strarray_size(strarray_t *arr)
@@ -132,22 +200,86 @@ size_t strarray_size(strarray_t *arr)
     return arr->size;
 }
 
-void strarray_append(strarray_t *arr, const void *buf, size_t sz)
+/* moves the live elements down to the beginning of the buffer, reclaiming
+ * the space left behind by strarray_pop_front() */
+static void strarray_compact(strarray_t *arr)
 {
-    const size_t cur_capacity = str_size(&arr->str) / arr->element_size;
-    size_t need_capacity = cur_capacity;
-    while ((arr->size + sz) > need_capacity)
-        need_capacity *= 2;
+    if (arr->offset == 0)
+        return;
+    memmove(arr->str.start,
+            arr->str.start + (arr->offset * arr->element_size),
+            arr->size * arr->element_size);
+    arr->offset = 0;
+}
 
-    if (need_capacity > cur_capacity) {
+/* compacts the array and moves it into storage for exactly capacity elements;
+ * realloc() is used when possible so the heap can grow the block in place */
+static void strarray_resize_storage(strarray_t *arr, size_t capacity)
+{
+    assert(capacity >= arr->size && capacity > 0);
+    strarray_compact(arr);
+
+    if (arr->str.start == arr->inline_buf) {
+        /* moving out of the inline storage: nothing to free */
         str_t newstr;
-        str_init(&newstr, need_capacity * arr->element_size);
+        str_init_alloc(&newstr, capacity * arr->element_size, arr->allocator);
         memcpy(newstr.start, arr->str.start, arr->size * arr->element_size);
-        str_take_ownership(&arr->str, &newstr);
-        str_uninit(&newstr);
+        memcpy(&arr->str, &newstr, sizeof(str_t));
+    }
+    else
+        str_realloc_alloc(&arr->str, capacity * arr->element_size,
+                          arr->allocator);
+}
+
+size_t strarray_capacity(strarray_t *arr)
+{
+    return str_size(&arr->str) / arr->element_size;
+}
+
+void strarray_reserve(strarray_t *arr, size_t capacity)
+{
+    if (capacity <= strarray_capacity(arr) - arr->offset)
+        return;
+    if (capacity <= strarray_capacity(arr))
+        strarray_compact(arr);
+    else
+        strarray_resize_storage(arr, capacity);
+}
+
+void strarray_shrink_to_fit(strarray_t *arr)
+{
+    /* inline storage cannot be shrunk */
+    if (arr->str.start == arr->inline_buf)
+        return;
+    strarray_resize_storage(arr, arr->size > 0 ? arr->size : 1);
+}
+
+void strarray_reserve_more(strarray_t *arr, size_t sz)
+{
+    const size_t cur_capacity = strarray_capacity(arr);
+    const size_t need_capacity = arr->size + sz;
+
+    if ((arr->offset + need_capacity) <= cur_capacity)
+        return;
+
+    if (arr->offset >= arr->size && need_capacity <= cur_capacity) {
+        /* the dead prefix is at least as large as the live data, so moving
+         * the live data is paid for by the pops that created the prefix */
+        strarray_compact(arr);
+    }
+    else {
+        /* grow geometrically, or straight to the needed size when a single
+         * append is larger than that */
+        strarray_resize_storage(arr, need_capacity > cur_capacity * 2 ?
+                                     need_capacity : cur_capacity * 2);
     }
+}
 
-    memcpy(arr->str.start + (arr->size * arr->element_size), buf, sz * arr->element_size);
+void strarray_append(strarray_t *arr, const void *buf, size_t sz)
+{
+    strarray_reserve_more(arr, sz);
+    memcpy(arr->str.start + ((arr->offset + arr->size) * arr->element_size),
+           buf, sz * arr->element_size);
     arr->size += sz;
 }
 
@@ -157,33 +289,30 @@ void strarray_set(strarray_t *arr, const void *buf, size_t sz)
     strarray_append(arr, buf, sz);
 }
 
-/* TODO: Alternate implementation is to simply forward the start pointer
- * rather than copy, making sure that appending more data does not result
- * in a degenerate situation */
+/* Only forwards the start of the array; the space in front is reclaimed by
+ * strarray_append() once it grows at least as large as the remaining data,
+ * making this O(1) amortized. */
 void strarray_pop_front(strarray_t *arr, size_t sz)
 {
-    const char *src, *src_end;
-    char *dest;
     assert(sz <= arr->size);
-    if (sz == 0)
-        return;
-
     arr->size -= sz;
-    dest = arr->str.start;
-    src = dest + sz * arr->element_size;
-    src_end = src + (arr->size * arr->element_size);
-    while (src < src_end)
-        *dest++ = *src++;
+    if (arr->size == 0)
+        arr->offset = 0;
+    else
+        arr->offset += sz;
 }
 
 void strarray_pop_back(strarray_t *arr, size_t sz)
 {
     assert(sz <= arr->size);
     arr->size -= sz;
+    if (arr->size == 0)
+        arr->offset = 0;
 }
 
 void strarray_get_strref(strarray_t *arr, seg_t *seg)
 {
     seg_from_str(seg, &arr->str);
+    seg->start += arr->offset * arr->element_size;
     seg->size = arr->size;
 }
@@ -17,6 +17,7 @@
 #ifndef STR_H
 #define STR_H
 
+#include "alloc.h"
 #include <assert.h>
 #include <string.h>
 
@@ -49,6 +50,20 @@ static size_t str_size(str_t *str)
 void str_uninit(str_t *str);
 void str_take_ownership(str_t *dst, str_t *src);
 
+/* same as above, but the memory comes from (and goes back to) allocator */
+void str_init_alloc(str_t *str, size_t size, struct allocator_t *allocator);
+void str_uninit_alloc(str_t *str, struct allocator_t *allocator);
+/* changes the size of str, preserving its contents up to the smaller size */
+void str_realloc_alloc(str_t *str, size_t size, struct allocator_t *allocator);
+void str_take_ownership_alloc(str_t *dst, str_t *src,
+                              struct allocator_t *allocator);
+
+
+/* C strings */
+
+/* returns a malloc()ed copy of src, to be released with free() */
+char *dup_str(const char *src);
+
 
 /* seg_t, ro_seg_t */
 
@@ -117,12 +132,34 @@ typedef struct _strarray_t
     str_t str;
     size_t size;
     size_t element_size;
+    /* number of elements popped from the front that have not been reclaimed
+     * yet; the live elements begin at str.start + offset * element_size */
+    size_t offset;
+    /* storage supplied by strarray_init_inline() which the array does not
+     * own; NULL if there is none */
+    char *inline_buf;
+    /* NULL means malloc()/free() */
+    struct allocator_t *allocator;
 } strarray_t;
 
 void strarray_init(strarray_t *arr, size_t element_size, size_t init_capacity);
+void strarray_init_alloc(strarray_t *arr, size_t element_size,
+                         size_t init_capacity, struct allocator_t *allocator);
+/* uses buf as the storage until the array outgrows it; buf must outlive the
+ * array and is never freed by it */
+void strarray_init_inline(strarray_t *arr, size_t element_size,
+                          void *buf, size_t capacity);
 void strarray_clear(strarray_t *arr);
 void strarray_uninit(strarray_t *arr);
 size_t strarray_size(strarray_t *arr);
+size_t strarray_capacity(strarray_t *arr);
+/* makes room for at least capacity elements so that appending up to that
+ * many does not reallocate */
+void strarray_reserve(strarray_t *arr, size_t capacity);
+/* gives back the unused capacity to the allocator */
+void strarray_shrink_to_fit(strarray_t *arr);
+/* makes room for sz more elements at the back, growing geometrically */
+void strarray_reserve_more(strarray_t *arr, size_t sz);
 void strarray_append(strarray_t *arr, const void *buf, size_t sz);
 void strarray_set(strarray_t *arr, const void *buf, size_t sz);
 void strarray_pop_front(strarray_t *arr, size_t sz);
@@ -132,12 +169,21 @@ void strarray_get_strref(strarray_t *arr, seg_t *seg);
 
 /* char_buffer_t */
 
+/* short contents (including the trailing null) are kept inside of the
+ * char_buffer_t itself, and only longer ones go to the heap */
+#define CHAR_BUFFER_INLINE_CAPACITY 48
+
+/* NOTE: refers to its own inline storage, so it must not be moved (memcpy-ed)
+ * after char_buffer_init() */
 struct char_buffer_t
 {
     strarray_t arr;
+    char inline_buf[CHAR_BUFFER_INLINE_CAPACITY];
 };
 
 void char_buffer_init(struct char_buffer_t *cb);
+void char_buffer_init_alloc(struct char_buffer_t *cb,
+                            struct allocator_t *allocator);
 void char_buffer_clear(struct char_buffer_t *cb);
 void char_buffer_uninit(struct char_buffer_t *cb);
 void char_buffer_append(struct char_buffer_t *cb, const char *buf, size_t sz);
@@ -147,5 +193,48 @@ void char_buffer_set_ro_seg(struct char_buffer_t *cb, const ro_seg_t *seg);
 void char_buffer_pop_front(struct char_buffer_t *cb, size_t sz);
 void char_buffer_get(struct char_buffer_t *cb, seg_t *seg);
 size_t char_buffer_size(struct char_buffer_t *cb);
+void char_buffer_push_char_slow(struct char_buffer_t *cb, char c);
+
+/* the trailing null char */
+#define CHAR_BUFFER_END(cb) \
+    ((cb)->arr.str.start + (cb)->arr.offset + (cb)->arr.size - 1)
+
+/* makes room for sz more chars, so that the *_unchecked functions below can
+ * be used to append them */
+static void char_buffer_reserve(struct char_buffer_t *cb, size_t sz)
+{
+    if (cb->arr.offset + cb->arr.size + sz > cb->arr.str.size)
+        strarray_reserve_more(&cb->arr, sz);
+}
+
+static void char_buffer_push_char_unchecked(struct char_buffer_t *cb, char c)
+{
+    char * const end = CHAR_BUFFER_END(cb);
+    assert(cb->arr.element_size == 1);
+    assert(cb->arr.offset + cb->arr.size < cb->arr.str.size);
+    end[0] = c;
+    end[1] = '\0';
+    ++cb->arr.size;
+}
+
+static void char_buffer_append_unchecked(struct char_buffer_t *cb,
+                                         const char *buf,
+                                         size_t sz)
+{
+    char * const end = CHAR_BUFFER_END(cb);
+    assert(cb->arr.element_size == 1);
+    assert(cb->arr.offset + cb->arr.size + sz <= cb->arr.str.size);
+    memcpy(end, buf, sz);
+    end[sz] = '\0';
+    cb->arr.size += sz;
+}
+
+static void char_buffer_push_char(struct char_buffer_t *cb, char c)
+{
+    if (cb->arr.offset + cb->arr.size < cb->arr.str.size)
+        char_buffer_push_char_unchecked(cb, c);
+    else
+        char_buffer_push_char_slow(cb, c);
+}
 
 #endif  /* STR_H */
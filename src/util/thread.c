@@ -0,0 +1,181 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "thread.h"
+#include <stdlib.h>
+
+struct thread_start_t
+{
+    thread_func_t func;
+    void *arg;
+};
+
+static struct thread_start_t *thread_start_new(thread_func_t func, void *arg)
+{
+    struct thread_start_t *start = (struct thread_start_t *)malloc(sizeof(struct thread_start_t));
+    start->func = func;
+    start->arg = arg;
+    return start;
+}
+
+static void thread_start_run(struct thread_start_t *start)
+{
+    const struct thread_start_t copy = *start;
+    free(start);
+    copy.func(copy.arg);
+}
+
+#ifdef _WIN32
+
+#include <process.h>
+
+static unsigned __stdcall thread_main(void *arg)
+{
+    thread_start_run((struct thread_start_t *)arg);
+    return 0;
+}
+
+int thread_create(thread_t *thread, thread_func_t func, void *arg)
+{
+    struct thread_start_t *start = thread_start_new(func, arg);
+    *thread = (HANDLE)_beginthreadex(NULL, 0, thread_main, start, 0, NULL);
+    if (*thread == 0) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_join(thread_t *thread)
+{
+    WaitForSingleObject(*thread, INFINITE);
+    CloseHandle(*thread);
+}
+
+void mutex_init(mutex_t *mutex)
+{
+    InitializeCriticalSection(mutex);
+}
+
+void mutex_uninit(mutex_t *mutex)
+{
+    DeleteCriticalSection(mutex);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+    EnterCriticalSection(mutex);
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+    LeaveCriticalSection(mutex);
+}
+
+void cond_init(cond_t *cond)
+{
+    InitializeConditionVariable(cond);
+}
+
+void cond_uninit(cond_t *cond)
+{
+    (void)cond;  /* nothing to release */
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+    SleepConditionVariableCS(cond, mutex, INFINITE);
+}
+
+void cond_signal(cond_t *cond)
+{
+    WakeConditionVariable(cond);
+}
+
+void cond_broadcast(cond_t *cond)
+{
+    WakeAllConditionVariable(cond);
+}
+
+#else  /* POSIX */
+
+static void *thread_main(void *arg)
+{
+    thread_start_run((struct thread_start_t *)arg);
+    return NULL;
+}
+
+int thread_create(thread_t *thread, thread_func_t func, void *arg)
+{
+    struct thread_start_t *start = thread_start_new(func, arg);
+    if (pthread_create(thread, NULL, thread_main, start) != 0) {
+        free(start);
+        return -1;
+    }
+    return 0;
+}
+
+void thread_join(thread_t *thread)
+{
+    pthread_join(*thread, NULL);
+}
+
+void mutex_init(mutex_t *mutex)
+{
+    pthread_mutex_init(mutex, NULL);
+}
+
+void mutex_uninit(mutex_t *mutex)
+{
+    pthread_mutex_destroy(mutex);
+}
+
+void mutex_lock(mutex_t *mutex)
+{
+    pthread_mutex_lock(mutex);
+}
+
+void mutex_unlock(mutex_t *mutex)
+{
+    pthread_mutex_unlock(mutex);
+}
+
+void cond_init(cond_t *cond)
+{
+    pthread_cond_init(cond, NULL);
+}
+
+void cond_uninit(cond_t *cond)
+{
+    pthread_cond_destroy(cond);
+}
+
+void cond_wait(cond_t *cond, mutex_t *mutex)
+{
+    pthread_cond_wait(cond, mutex);
+}
+
+void cond_signal(cond_t *cond)
+{
+    pthread_cond_signal(cond);
+}
+
+void cond_broadcast(cond_t *cond)
+{
+    pthread_cond_broadcast(cond);
+}
+
+#endif  /* _WIN32 */
@@ -0,0 +1,92 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef THREAD_H
+#define THREAD_H
+
+/* thin portability layer over Win32 and POSIX threading primitives */
+
+#ifdef _WIN32
+#include <windows.h>
+typedef CRITICAL_SECTION mutex_t;
+typedef CONDITION_VARIABLE cond_t;
+typedef HANDLE thread_t;
+#else
+#include <pthread.h>
+typedef pthread_mutex_t mutex_t;
+typedef pthread_cond_t cond_t;
+typedef pthread_t thread_t;
+#endif
+
+typedef void (* thread_func_t)(void *);
+
+/* returns 0, or -1 when the thread could not be started */
+int thread_create(thread_t *thread, thread_func_t func, void *arg);
+void thread_join(thread_t *thread);
+
+void mutex_init(mutex_t *mutex);
+void mutex_uninit(mutex_t *mutex);
+void mutex_lock(mutex_t *mutex);
+void mutex_unlock(mutex_t *mutex);
+
+void cond_init(cond_t *cond);
+void cond_uninit(cond_t *cond);
+/* mutex must be locked; as usual, wakeups can be spurious */
+void cond_wait(cond_t *cond, mutex_t *mutex);
+void cond_signal(cond_t *cond);
+void cond_broadcast(cond_t *cond);
+
+/* sequentially consistent atomic load and store */
+
+static long atomic_get(volatile long *value)
+{
+#ifdef _WIN32
+    return InterlockedCompareExchange(value, 0, 0);
+#else
+    return __atomic_load_n(value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+static void atomic_set(volatile long *value, long new_value)
+{
+#ifdef _WIN32
+    InterlockedExchange(value, new_value);
+#else
+    __atomic_store_n(value, new_value, __ATOMIC_SEQ_CST);
+#endif
+}
+
+/* atomic counters; both return the new value */
+
+static long atomic_increment(volatile long *value)
+{
+#ifdef _WIN32
+    return InterlockedIncrement(value);
+#else
+    return __atomic_add_fetch(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+static long atomic_decrement(volatile long *value)
+{
+#ifdef _WIN32
+    return InterlockedDecrement(value);
+#else
+    return __atomic_sub_fetch(value, 1, __ATOMIC_ACQ_REL);
+#endif
+}
+
+#endif  /* THREAD_H */
@@ -5,9 +5,15 @@
 #include <windows.h>
 typedef unsigned __int8  uint8_t;
 typedef unsigned __int16 uint16_t;
+typedef unsigned __int32 uint32_t;
 typedef __int64          int64_t;
 typedef unsigned __int64 uint64_t;
 typedef SSIZE_T          ssize_t;
+#define UINT32_MAX       0xffffffffui32
+#define UINT64_MAX       0xffffffffffffffffui64
+#else
+#include <stdint.h>
+#include <sys/types.h>
 #endif
 
 #endif /* __TYPES___H____ */
@@ -0,0 +1,327 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "utf8.h"
+#include "scan.h"
+#include <assert.h>
+
+#ifdef SCAN_X86
+#   include <emmintrin.h>
+#   include <immintrin.h>
+#endif
+
+/* bytes handed to the scalar validator between attempts of the vectorized
+ * one */
+#define UTF8_SCALAR_RUN 32
+
+void utf8_state_init(struct utf8_state_t *state)
+{
+    state->pending = 0;
+    state->lower = 0x80;
+    state->upper = 0xbf;
+}
+
+int utf8_state_is_complete(const struct utf8_state_t *state)
+{
+    return state->pending == 0;
+}
+
+/* returns -1 on invalid input */
+static int utf8_scalar_step(struct utf8_state_t *state, unsigned char c)
+{
+    if (state->pending > 0) {
+        if (c < state->lower || c > state->upper)
+            return -1;
+        --state->pending;
+        state->lower = 0x80;
+        state->upper = 0xbf;
+        return 0;
+    }
+
+    if (c < 0x80)
+        return 0;
+    else if (c < 0xc2)
+        return -1;  /* continuation byte, or overlong 2-byte lead */
+    else if (c < 0xe0)
+        state->pending = 1;
+    else if (c < 0xf0) {
+        state->pending = 2;
+        if (c == 0xe0)
+            state->lower = 0xa0;  /* overlong */
+        else if (c == 0xed)
+            state->upper = 0x9f;  /* surrogates */
+    }
+    else if (c < 0xf5) {
+        state->pending = 3;
+        if (c == 0xf0)
+            state->lower = 0x90;  /* overlong */
+        else if (c == 0xf4)
+            state->upper = 0x8f;  /* above U+10FFFF */
+    }
+    else
+        return -1;
+
+    return 0;
+}
+
+#ifdef SCAN_X86
+
+/* SSE2: skips 16-byte blocks of ASCII */
+
+SCAN_TARGET_SSE2
+static size_t sse2_utf8_blocks(const unsigned char *buf, size_t size, int *error)
+{
+    size_t i = 0;
+    *error = 0;
+    for (; i + 16 <= size; i += 16) {
+        const __m128i v = _mm_loadu_si128((const __m128i *)(buf + i));
+        if (_mm_movemask_epi8(v) != 0)
+            break;
+    }
+    return i;
+}
+
+/* AVX2: Keiser & Lemire, "Validating UTF-8 In Less Than One Instruction Per
+ * Byte".  Each byte is classified by three 16-entry table lookups (the high
+ * nibble of the previous byte, its low nibble, and the high nibble of the
+ * byte itself); the AND of the three is non-zero exactly for the invalid
+ * two-byte combinations.  The 3rd and 4th bytes of longer sequences are
+ * checked separately from the bytes two and three positions back. */
+
+#define TOO_SHORT      (1 << 0)
+#define TOO_LONG       (1 << 1)
+#define OVERLONG_3     (1 << 2)
+#define TOO_LARGE      (1 << 3)
+#define SURROGATE      (1 << 4)
+#define OVERLONG_2     (1 << 5)
+#define TOO_LARGE_1000 (1 << 6)
+#define OVERLONG_4     (1 << 6)
+#define TWO_CONTS      (1 << 7)
+#define CARRY          (TOO_SHORT | TOO_LONG | TWO_CONTS)
+
+/* the same 16-byte table in both 128-bit lanes, for _mm256_shuffle_epi8 */
+#define AVX2_TABLE16(a, b, c, d, e, f, g, h, i, j, k, l, m, n, o, p) \
+    _mm256_setr_epi8((char)(a), (char)(b), (char)(c), (char)(d), \
+                     (char)(e), (char)(f), (char)(g), (char)(h), \
+                     (char)(i), (char)(j), (char)(k), (char)(l), \
+                     (char)(m), (char)(n), (char)(o), (char)(p), \
+                     (char)(a), (char)(b), (char)(c), (char)(d), \
+                     (char)(e), (char)(f), (char)(g), (char)(h), \
+                     (char)(i), (char)(j), (char)(k), (char)(l), \
+                     (char)(m), (char)(n), (char)(o), (char)(p))
+
+/* input shifted by n bytes, with the last n bytes of prev shifted in */
+#define AVX2_PREV(input, prev, n) \
+    _mm256_alignr_epi8((input), \
+                       _mm256_permute2x128_si256((prev), (input), 0x21), \
+                       16 - (n))
+
+SCAN_TARGET_AVX2
+static __m256i avx2_high_nibbles(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0f));
+}
+
+SCAN_TARGET_AVX2
+static __m256i avx2_utf8_check_block(__m256i input, __m256i prev_input)
+{
+    const __m256i byte_1_high_table = AVX2_TABLE16(
+        /* 0_______ ________ */
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        TOO_LONG, TOO_LONG, TOO_LONG, TOO_LONG,
+        /* 10______ ________ */
+        TWO_CONTS, TWO_CONTS, TWO_CONTS, TWO_CONTS,
+        /* 1100____ ________ */
+        TOO_SHORT | OVERLONG_2,
+        /* 1101____ ________ */
+        TOO_SHORT,
+        /* 1110____ ________ */
+        TOO_SHORT | OVERLONG_3 | SURROGATE,
+        /* 1111____ ________ */
+        TOO_SHORT | TOO_LARGE | TOO_LARGE_1000 | OVERLONG_4);
+    const __m256i byte_1_low_table = AVX2_TABLE16(
+        /* ____0000 ________ */
+        CARRY | OVERLONG_3 | OVERLONG_2 | OVERLONG_4,
+        /* ____0001 ________ */
+        CARRY | OVERLONG_2,
+        /* ____001_ ________ */
+        CARRY,
+        CARRY,
+        /* ____0100 ________ */
+        CARRY | TOO_LARGE,
+        /* ____0101 ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        /* ____011_ ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        /* ____1___ ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        /* ____1101 ________ */
+        CARRY | TOO_LARGE | TOO_LARGE_1000 | SURROGATE,
+        CARRY | TOO_LARGE | TOO_LARGE_1000,
+        CARRY | TOO_LARGE | TOO_LARGE_1000);
+    const __m256i byte_2_high_table = AVX2_TABLE16(
+        /* ________ 0_______ */
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT,
+        /* ________ 1000____ */
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE_1000 | OVERLONG_4,
+        /* ________ 1001____ */
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | OVERLONG_3 | TOO_LARGE,
+        /* ________ 101_____ */
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        TOO_LONG | OVERLONG_2 | TWO_CONTS | SURROGATE | TOO_LARGE,
+        /* ________ 11______ */
+        TOO_SHORT, TOO_SHORT, TOO_SHORT, TOO_SHORT);
+
+    const __m256i prev1 = AVX2_PREV(input, prev_input, 1);
+    const __m256i prev2 = AVX2_PREV(input, prev_input, 2);
+    const __m256i prev3 = AVX2_PREV(input, prev_input, 3);
+    __m256i special_cases, must23;
+
+    special_cases = _mm256_and_si256(
+        _mm256_and_si256(
+            _mm256_shuffle_epi8(byte_1_high_table, avx2_high_nibbles(prev1)),
+            _mm256_shuffle_epi8(byte_1_low_table,
+                                _mm256_and_si256(prev1, _mm256_set1_epi8(0x0f)))),
+        _mm256_shuffle_epi8(byte_2_high_table, avx2_high_nibbles(input)));
+
+    /* 0x80 where the byte has to be the 3rd or 4th one of a sequence:
+     * only 111_____ two bytes back and 1111____ three bytes back are left
+     * with the high bit set */
+    must23 = _mm256_or_si256(
+        _mm256_subs_epu8(prev2, _mm256_set1_epi8((char)(0xe0 - 0x80))),
+        _mm256_subs_epu8(prev3, _mm256_set1_epi8((char)(0xf0 - 0x80))));
+    must23 = _mm256_and_si256(must23, _mm256_set1_epi8((char)0x80));
+
+    return _mm256_xor_si256(must23, special_cases);
+}
+
+/* non-zero where the block ends in the middle of a sequence */
+SCAN_TARGET_AVX2
+static __m256i avx2_utf8_is_incomplete(__m256i input)
+{
+    const __m256i max_value = _mm256_setr_epi8(
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)255, (char)255, (char)255, (char)255, (char)255,
+        (char)(0xf0 - 1), (char)(0xe0 - 1), (char)(0xc0 - 1));
+    return _mm256_subs_epu8(input, max_value);
+}
+
+SCAN_TARGET_AVX2
+static size_t avx2_utf8_blocks(const unsigned char *buf, size_t size, int *error)
+{
+    __m256i prev_input = _mm256_setzero_si256();
+    __m256i prev_incomplete = _mm256_setzero_si256();
+    __m256i errors = _mm256_setzero_si256();
+    size_t i = 0;
+
+    /* the caller guarantees that no sequence is pending, which makes the
+     * bytes before buf equivalent to ASCII (zeros) for the checks */
+    for (; i + 32 <= size; i += 32) {
+        const __m256i input = _mm256_loadu_si256((const __m256i *)(buf + i));
+        if (_mm256_movemask_epi8(input) == 0) {
+            /* ASCII: only a sequence cut off by it is an error */
+            errors = _mm256_or_si256(errors, prev_incomplete);
+            prev_incomplete = _mm256_setzero_si256();
+        }
+        else {
+            errors = _mm256_or_si256(errors,
+                avx2_utf8_check_block(input, prev_input));
+            prev_incomplete = avx2_utf8_is_incomplete(input);
+        }
+        prev_input = input;
+    }
+
+    *error = !_mm256_testz_si256(errors, errors);
+
+    /* leave a sequence that is cut off at the end of the last block to the
+     * scalar validator */
+    if (i > 0 && !_mm256_testz_si256(prev_incomplete, prev_incomplete)) {
+        size_t k;
+        for (k = 1; k <= 3; ++k) {
+            if (buf[i - k] >= 0xc0) {
+                i -= k;
+                break;
+            }
+        }
+    }
+
+    return i;
+}
+
+#endif  /* SCAN_X86 */
+
+/* validates whole blocks with the vectorized implementation; requires that
+ * no sequence is pending, and leaves none pending */
+static size_t utf8_vector_blocks(enum scan_isa_t isa,
+                                 const unsigned char *buf,
+                                 size_t size,
+                                 int *error)
+{
+    *error = 0;
+#ifdef SCAN_X86
+    if (isa == SCAN_ISA_AVX2)
+        return avx2_utf8_blocks(buf, size, error);
+    if (isa == SCAN_ISA_SSE2)
+        return sse2_utf8_blocks(buf, size, error);
+#endif
+    (void)isa; (void)buf; (void)size;
+    return 0;
+}
+
+int utf8_validate(struct utf8_state_t *state, const ro_seg_t *seg)
+{
+    const unsigned char *p = (const unsigned char *)seg->start;
+    const unsigned char * const end = p + seg->size;
+    const enum scan_isa_t isa = scan_get_isa();
+
+    while (p < end) {
+        const unsigned char *scalar_end;
+
+        if (state->pending == 0 && isa != SCAN_ISA_PORTABLE) {
+            int error;
+            p += utf8_vector_blocks(isa, p, (size_t)(end - p), &error);
+            if (error)
+                return -1;
+        }
+
+        /* whatever the vectorized validator left behind, and any sequence
+         * which is still pending after that */
+        scalar_end = (size_t)(end - p) > UTF8_SCALAR_RUN ?
+            p + UTF8_SCALAR_RUN : end;
+        while (p < end && (p < scalar_end || state->pending > 0)) {
+            if (utf8_scalar_step(state, *p++))
+                return -1;
+        }
+    }
+
+    return 0;
+}
+
+int utf8_is_valid(const ro_seg_t *seg)
+{
+    struct utf8_state_t state;
+    utf8_state_init(&state);
+    return utf8_validate(&state, seg) == 0 && utf8_state_is_complete(&state);
+}
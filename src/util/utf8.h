@@ -0,0 +1,47 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef UTF8_H
+#define UTF8_H
+
+#include "str.h"
+
+/* Streaming UTF-8 validation.  The input may be split into chunks at any
+ * byte; utf8_state_t carries a sequence which is cut off at the end of one
+ * chunk over to the next.  With AVX2 whole 32-byte blocks are validated at
+ * once using the Keiser-Lemire lookup algorithm; with SSE2 only runs of
+ * ASCII are skipped quickly. */
+
+struct utf8_state_t
+{
+    /* continuation bytes still expected */
+    unsigned pending;
+    /* valid range of the next continuation byte */
+    unsigned char lower;
+    unsigned char upper;
+};
+
+void utf8_state_init(struct utf8_state_t *state);
+/* returns 0 if seg is valid UTF-8 when following the data already seen by
+ * state, or -1 otherwise (after which state has to be re-initialized) */
+int utf8_validate(struct utf8_state_t *state, const ro_seg_t *seg);
+/* returns 1 if the data seen so far does not end in the middle of a
+ * sequence */
+int utf8_state_is_complete(const struct utf8_state_t *state);
+
+int utf8_is_valid(const ro_seg_t *seg);
+
+#endif  /* UTF8_H */
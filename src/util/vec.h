@@ -0,0 +1,118 @@
+/*
+ * Copyright 2015 Igor Stojanovski
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef VEC_H
+#define VEC_H
+
+#include "alloc.h"
+#include <assert.h>
+#include <stddef.h>
+
+/* Typed counterpart of strarray_t: the element type is known at compile
+ * time, so accessing and appending elements boils down to plain loads and
+ * stores.  For example,
+ *
+ *     DEFINE_VEC(seg_vec, ro_seg_t)
+ *
+ * defines seg_vec_t together with seg_vec_init(), seg_vec_push_back(),
+ * seg_vec_at(), etc.  Memory comes from the allocator given to
+ * *_init_alloc(), or from malloc() when it is NULL. */
+
+#define VEC_INIT_CAPACITY 8
+
+#define DEFINE_VEC(name, type) \
+\
+typedef struct _##name##_t \
+{ \
+    type *data; \
+    size_t size; \
+    size_t capacity; \
+    struct allocator_t *allocator; \
+} name##_t; \
+\
+static void name##_init_alloc(name##_t *vec, struct allocator_t *allocator) \
+{ \
+    vec->data = NULL; \
+    vec->size = 0; \
+    vec->capacity = 0; \
+    vec->allocator = allocator; \
+} \
+\
+static void name##_init(name##_t *vec) \
+{ \
+    name##_init_alloc(vec, NULL); \
+} \
+\
+static void name##_uninit(name##_t *vec) \
+{ \
+    allocator_free(vec->allocator, vec->data, vec->capacity * sizeof(type)); \
+} \
+\
+static size_t name##_size(const name##_t *vec) \
+{ \
+    return vec->size; \
+} \
+\
+static void name##_clear(name##_t *vec) \
+{ \
+    vec->size = 0; \
+} \
+\
+static void name##_reserve(name##_t *vec, size_t capacity) \
+{ \
+    if (capacity <= vec->capacity) \
+        return; \
+    vec->data = (type *)allocator_realloc(vec->allocator, \
+                                          vec->data, \
+                                          vec->capacity * sizeof(type), \
+                                          capacity * sizeof(type)); \
+    vec->capacity = capacity; \
+} \
+\
+/* kept apart from push_back() so that the latter stays small */ \
+static void name##_grow(name##_t *vec) \
+{ \
+    name##_reserve(vec, vec->capacity > 0 ? \
+                        vec->capacity * 2 : VEC_INIT_CAPACITY); \
+} \
+\
+static type *name##_push_back(name##_t *vec, type elem) \
+{ \
+    if (vec->size == vec->capacity) \
+        name##_grow(vec); \
+    vec->data[vec->size] = elem; \
+    return &vec->data[vec->size++]; \
+} \
+\
+static type *name##_at(name##_t *vec, size_t i) \
+{ \
+    assert(i < vec->size); \
+    return &vec->data[i]; \
+} \
+\
+static type *name##_back(name##_t *vec) \
+{ \
+    assert(vec->size > 0); \
+    return &vec->data[vec->size - 1]; \
+} \
+\
+static type name##_pop_back(name##_t *vec) \
+{ \
+    assert(vec->size > 0); \
+    return vec->data[--vec->size]; \
+}
+
+#endif  /* VEC_H */